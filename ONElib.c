@@ -677,12 +677,14 @@ static void oneFileDestroy (OneFile *vf)
       for (j = 1; j < vf->share; j++)
         { provRefDefCleanup (&vf[j]) ;
           if (vf[j].codecBuf   != NULL) free (vf[j].codecBuf);
+          if (vf[j].asciiBuf   != NULL) free (vf[j].asciiBuf);
           if (vf[j].f          != NULL) fclose (vf[j].f);
         }
     }
 
   provRefDefCleanup (vf) ;
   if (vf->codecBuf != NULL) free (vf->codecBuf);
+  if (vf->asciiBuf != NULL) free (vf->asciiBuf);
   if (vf->f != NULL && vf->f != stdout) fclose (vf->f);
 
   for (i = 0; i < 128 ; i++)
@@ -743,11 +745,6 @@ static inline void eatWhite (OneFile *vf)
   parseError (vf, "failed to find expected space separation character lineType %c", vf->lineType);
 }
 
-static inline char readChar(OneFile *vf)
-{ eatWhite(vf);
-  return vfGetc(vf);
-}
-
 static inline char *readBuf(OneFile *vf)
 { char x, *cp, *endBuf;
 
@@ -784,19 +781,6 @@ static inline I64 readInt(OneFile *vf)
   return x;
 }
 
-static inline double readReal(OneFile *vf)
-{ char  *e, *b;
-  double x;
-
-  b = readBuf(vf);
-  x = strtod (b, &e);
-  if (e == b)
-    parseError (vf, "empty real field");
-  if (*e != '\0')
-    parseError (vf, "bad real");
-  return (x);
-}
-
 static inline void readString(OneFile *vf, char *buf, I64 n)
 { eatWhite (vf);
   if (vf->isCheckString)
@@ -816,40 +800,6 @@ static inline void readString(OneFile *vf, char *buf, I64 n)
     }
 }
 
-static inline void readFlush (OneFile *vf) // reads to the end of the line and stores as comment
-{ char       x;
-  int        n = 0;
-  OneInfo   *li = vf->info['/'] ;
-
-  // check the first character - if it is newline then done
-  x = getc (vf->f) ; 
-  if (x == '\n')
-    return ;
-  else if (x != ' ')
-    parseError (vf, "comment not separated by a space") ;
-
-  // else the remainder of the line is a comment
-  if (!li->bufSize)
-    { li->bufSize = 1024 ;
-      li->buffer = new (li->bufSize, char) ;
-    }
-  while ((x = getc (vf->f)) && x != '\n')
-    if (x == EOF)
-      parseError (vf, "premature end of file");
-    else
-      { if ((n+1) >= li->bufSize)
-	  { char *s = new (2*li->bufSize, char) ;
-	    memcpy (s, li->buffer, li->bufSize) ;
-	    free (li->buffer) ;
-	    li->buffer = s ;
-	    li->bufSize *= 2 ;
-	  }
-	((char*)li->buffer)[n] = x ;
-	++n ;
-      }
-  ((char*)li->buffer)[n] = 0 ; // string terminator
-}
-
 
 /***********************************************************************************
  *
@@ -867,9 +817,9 @@ static inline void updateTotalAndBuffer (OneFile *vf, char t, I64 size, I64 nStr
   if (size > li->accum.max)
     li->accum.max = size;
   size += nStrings;             // need to allocate space for terminal 0s
-  if ( ! li->isUserBuf && size > li->bufSize)   // expand buffer
+  if ( ! li->isUserBuf && size > li->bufSize)   // expand buffer, geometrically
     { if (li->buffer != NULL) free (li->buffer);
-      li->bufSize = size + 0x10000 ;
+      li->bufSize = size + (size >> 1) + 0x10000 ;
       li->buffer  = new (li->bufSize*li->listEltSize, void);
     }
 }
@@ -1017,32 +967,213 @@ static inline void readCompressedFields (FILE *f, OneField *field, OneInfo *li)
  *
  **********************************************************************************/
 
-  //  Read a string list, first into new allocs, then into sized line buffer.
-  //    Annoyingly inefficient, but we don't use it very much.
+  //  Grow a list buffer keeping its contents, for when the final size is not known in advance
+
+static void growListBuffer (OneInfo *li, I64 size)
+{
+  if (li->isUserBuf || size <= li->bufSize) return ; // user buffers must be big enough already
+  I64   newSize = size + (size >> 1) + 0x10000 ;
+  void *b = new (newSize*li->listEltSize, void) ;
+  if (li->buffer)
+    { memcpy (b, li->buffer, li->bufSize*li->listEltSize) ;
+      free (li->buffer) ;
+    }
+  li->buffer  = b ;
+  li->bufSize = newSize ;
+}
+
+  //  Read a string list directly into the line buffer, as 0-terminated strings
 
 static void readStringList(OneFile *vf, char t, I64 len)
-{ int    j;
-  I64    totLen, sLen;
-  char **string, *buf;
+{ OneInfo *li = vf->info[(int) t];
+  int      j;
+  I64      totLen, sLen, used;
 
-  totLen = 0;
-  string = new (len, char *);
+  totLen = used = 0;
   for (j = 0; j < len ; ++j)
     { sLen = readInt (vf);
+      growListBuffer (li, used + sLen + 1);
+      readString (vf, (char*) li->buffer + used, sLen);
+      used   += sLen + 1;
       totLen += sLen;
-      string[j] = new (sLen+1, char);
-      readString (vf, string[j], sLen);
     }
 
-  updateTotalAndBuffer (vf, t, totLen, len);
+  li->accum.total += totLen;    // as in updateTotalAndBuffer()
+  if (totLen > li->accum.max)
+    li->accum.max = totLen;
+}
+
+/***********************************************************************************
+ *
+ *    ASCII LINE PARSING: each ascii line is read whole by getline(), which finds the
+ *      newline in bulk, into vf->asciiBuf, and its fields are then parsed from memory
+ *
+ **********************************************************************************/
+
+static void lineSetError (OneFile *vf, char *p) // put the line so far into lineBuf for parseError()
+{ I64 n = p - vf->asciiBuf ;
+  if (n > 126) n = 126 ;
+  if (n < 0) n = 0 ;
+  memcpy (vf->lineBuf + 1, vf->asciiBuf, n) ; // lineBuf[0] is the line type
+  vf->linePos = n + 1 ;
+}
+
+#define LINE_ERROR(vf,p,...) { lineSetError (vf, p) ; parseError (vf, __VA_ARGS__) ; }
+
+static void lineRead (OneFile *vf) // reads the rest of the line after the type character
+{ size_t  size = vf->asciiBufSize ;
+  ssize_t n    = getline (&vf->asciiBuf, &size, vf->f) ;
+
+  vf->asciiBufSize = size ;
+  if (n > 0)
+    vf->asciiBufLen = n ;
+  else
+    { vf->asciiBufLen = 0 ;
+      if (vf->asciiBuf) *vf->asciiBuf = 0 ;
+    }
+}
+
+static bool lineMore (OneFile *vf, char **pp) // append next line, for strings containing '\n'
+{ char   *extra = 0 ;
+  size_t  size = 0 ;
+  ssize_t n = getline (&extra, &size, vf->f) ;
+
+  if (n > 0)
+    { I64 pos = *pp - vf->asciiBuf ;
+      if (vf->asciiBufLen + n + 1 > vf->asciiBufSize)
+	{ vf->asciiBufSize = vf->asciiBufLen + n + 1 ;
+	  vf->asciiBuf = realloc (vf->asciiBuf, vf->asciiBufSize) ;
+	  if (!vf->asciiBuf) die ("ONE read error: failed to extend line buffer") ;
+	}
+      memcpy (vf->asciiBuf + vf->asciiBufLen, extra, n+1) ; // includes terminating 0
+      vf->asciiBufLen += n ;
+      *pp = vf->asciiBuf + pos ;
+    }
+  free (extra) ;
+  return (n > 0) ;
+}
+
+static inline void lineWhite (OneFile *vf, char **pp)
+{ if (**pp != ' ')
+    LINE_ERROR (vf, *pp, "failed to find expected space separation character lineType %c",
+		vf->lineType) ;
+  ++*pp ;
+}
+
+static I64 lineIntSlow (OneFile *vf, char **pp) // handles everything that lineInt() does not
+{ char *b = *pp, *e, *end ;
+  I64   x ;
+
+  for (e = b ; *e && !isspace(*e) ; ++e) ;
+  if (e - b >= 32)
+    LINE_ERROR (vf, e, "overlong item") ;
+  memcpy (vf->numberBuf, b, e - b) ;
+  vf->numberBuf[e-b] = 0 ;
+  x = strtoll (vf->numberBuf, &end, 10) ;
+  if (end == vf->numberBuf)
+    LINE_ERROR (vf, e, "empty int field") ;
+  if (*end != '\0')
+    LINE_ERROR (vf, e, "bad int") ;
+  *pp = e ;
+  return x ;
+}
+
+static inline I64 lineInt (OneFile *vf, char **pp)
+{ char *p, *d ;
+  U64   u = 0 ;
+
+  lineWhite (vf, pp) ;
+  p = *pp ;
+  if (*p == '-') ++p ;
+  d = p ;
+  while (*p >= '0' && *p <= '9')
+    u = u*10 + (*p++ - '0') ;
+  if (p == d || p - d > 18 || (*p != ' ' && *p != '\n' && *p != 0))
+    return lineIntSlow (vf, pp) ;
+  if (**pp == '-')
+    { *pp = p ; return -(I64)u ; }
+  *pp = p ;
+  return (I64) u ;
+}
+
+static inline double lineReal (OneFile *vf, char **pp)
+{ char  *e ;
+  double x ;
+
+  lineWhite (vf, pp) ;
+  if (isspace (**pp) || !**pp)
+    LINE_ERROR (vf, *pp, "empty real field") ;
+  x = strtod (*pp, &e) ;
+  if (e == *pp)
+    LINE_ERROR (vf, e, "empty real field") ;
+  if (*e && !isspace (*e))
+    LINE_ERROR (vf, e, "bad real") ;
+  *pp = e ;
+  return x ;
+}
+
+static inline char lineChar (OneFile *vf, char **pp)
+{ char c ;
 
-  buf = (char *) vf->info[(int) t]->buffer;
+  lineWhite (vf, pp) ;
+  c = **pp ;
+  if (c) ++*pp ;
+  return c ;
+}
+
+static inline void lineString (OneFile *vf, char **pp, char *buf, I64 n)
+{
+  lineWhite (vf, pp) ;
+  while (vf->asciiBuf + vf->asciiBufLen - *pp < n)
+    if (vf->isCheckString)
+      LINE_ERROR (vf, vf->asciiBuf + vf->asciiBufLen, "line too short %d", n)
+    else if (!lineMore (vf, pp))
+      die ("ONE parse error: failed to read %d byte string", n) ;
+  if (vf->isCheckString && memchr (*pp, '\n', n))
+    LINE_ERROR (vf, *pp, "line too short %d", n) ;
+  memcpy (buf, *pp, n) ;
+  buf[n] = 0 ;
+  *pp += n ;
+}
+
+static void lineStringList (OneFile *vf, char **pp, char t, I64 len)
+{ OneInfo *li = vf->info[(int) t];
+  int      j;
+  I64      totLen, sLen, used;
+
+  totLen = used = 0;
   for (j = 0; j < len ; ++j)
-    { strcpy (buf, string[j]);
-      buf += strlen(buf) + 1;
-      free (string[j]);
+    { sLen = lineInt (vf, pp);
+      growListBuffer (li, used + sLen + 1);
+      lineString (vf, pp, (char*) li->buffer + used, sLen);
+      used   += sLen + 1;
+      totLen += sLen;
+    }
+
+  li->accum.total += totLen;    // as in updateTotalAndBuffer()
+  if (totLen > li->accum.max)
+    li->accum.max = totLen;
+}
+
+static void lineFlush (OneFile *vf, char *p) // stores the rest of the line as a comment
+{ OneInfo *li = vf->info['/'] ;
+  char    *end = vf->asciiBuf + vf->asciiBufLen ;
+  I64      n ;
+
+  if (p >= end || *p == '\n')
+    return ;
+  if (*p != ' ')
+    LINE_ERROR (vf, p, "comment not separated by a space") ;
+  ++p ;
+  if (end[-1] == '\n') --end ;
+  n = end - p ;
+  if (n + 1 > li->bufSize)
+    { if (li->buffer) free (li->buffer) ;
+      li->bufSize = (n + 1 > 1024) ? 2*(n + 1) : 1024 ;
+      li->buffer = new (li->bufSize, char) ;
     }
-  free (string);
+  memcpy (li->buffer, p, n) ;
+  ((char*)li->buffer)[n] = 0 ; // string terminator
 }
 
 bool addProvenance(OneFile *vf, OneProvenance *from, int n) ; // need forward declaration
@@ -1086,57 +1217,58 @@ char oneReadLine (OneFile *vf)
     *(char*)(vf->info['/']->buffer) = 0 ;
 
   vf->nBits = 0 ;        // will use for any compressed data read in
+  vf->isListDecoded = false ;
   
-  if (isAscii)           // read field by field according to ascii spec
+  if (isAscii)           // read the whole line, then parse field by field according to ascii spec
     { int     i, j;
       I64    *ilst, len;
       double *rlst;
+      char   *p;
 
+      lineRead (vf);
+      p = vf->asciiBuf;
       for (i = 0; i < li->nField; i++)
         switch (li->fieldType[i])
 	  {
 	  case oneINT:
-            vf->field[i].i = readInt (vf);
-	    //	    printf ("  field %d int %d\n", i, (int)oneInt(vf,i)) ; 
+            vf->field[i].i = lineInt (vf, &p);
 	    break;
           case oneREAL:
-            vf->field[i].r = readReal (vf);
+            vf->field[i].r = lineReal (vf, &p);
             break;
           case oneCHAR:
-            vf->field[i].c = readChar (vf);
-	    //	    printf ("  field %d char %c\n", i, (int)oneChar(vf,i)) ;
+            vf->field[i].c = lineChar (vf, &p);
             break;
 	  case oneSTRING:
 	  case oneDNA:
-            len = readInt (vf);
+            len = lineInt (vf, &p);
             vf->field[i].len = len;
             updateTotalAndBuffer (vf, t, len, 1);
-            readString (vf, (char*) li->buffer, len);
+            lineString (vf, &p, (char*) li->buffer, len);
             break;
           case oneINT_LIST:
-            len = readInt (vf);
+            len = lineInt (vf, &p);
             vf->field[i].len = len;
             updateTotalAndBuffer (vf, t, len, 0);
             ilst = (I64 *) li->buffer;
             for (j = 0; j < len; ++j)
-              ilst[j] = readInt(vf);
+              ilst[j] = lineInt (vf, &p);
             break;
           case oneREAL_LIST:
-            len = readInt (vf);
+            len = lineInt (vf, &p);
             vf->field[i].len = len;
             updateTotalAndBuffer (vf, t, len, 0);
             rlst = (double *) li->buffer;
             for (j = 0; j < len; ++j)
-              rlst[j] = readReal (vf);
+              rlst[j] = lineReal (vf, &p);
             break;
-          case oneSTRING_LIST: // STRING_LIST - inefficient for now - also used for binary
-            len = readInt (vf);
+          case oneSTRING_LIST:
+            len = lineInt (vf, &p);
             vf->field[i].len = len;
-	    //	    printf ("  field %d string list len %d\n", i, (int)oneLen(vf)) ;
-            readStringList (vf, t, len);
+            lineStringList (vf, &p, t, len);
             break;
 	  }
-      readFlush (vf);
+      lineFlush (vf, p);
     }
 
   else        // binary - block read fields and list, potentially compressed
@@ -1152,9 +1284,7 @@ char oneReadLine (OneFile *vf)
         { I64 listLen = oneLen(vf);
 
           if (listLen > 0)
-            { li->accum.total += listLen;
-	      if (listLen > li->accum.max)
-		li->accum.max = listLen;
+            { updateTotalAndBuffer (vf, t, listLen, 1); // buffer can be missing, e.g. for comments
 
 	      if (li->fieldType[li->listField] == oneINT_LIST)
 		{ *(I64*)li->buffer = ltfRead (vf->f) ;
@@ -1205,6 +1335,7 @@ char oneReadLine (OneFile *vf)
 	    vf->lineType = t ;
 	    vf->field[0] = keepField0 ;
 	    vf->nBits = keepNbits ;
+	    vf->isListDecoded = false ;
 	  }
       }
     }
@@ -1225,14 +1356,16 @@ void *_oneList (OneFile *vf)
 {
   OneInfo *li = vf->info[(int) vf->lineType] ;
 
-  if (vf->nBits)
-    { if (li->fieldType[li->listField] == oneINT_LIST) // first elt is already in buffer
+  if (vf->nBits && !vf->isListDecoded)
+    { li->codedBytes += (vf->nBits+7) >> 3 ;
+      li->plainBytes += oneLen(vf) * li->listEltSize ;
+      if (li->fieldType[li->listField] == oneINT_LIST) // first elt is already in buffer
 	{ vcDecode (li->listCodec, vf->nBits, vf->codecBuf, (char*)&(((I64*)li->buffer)[1])) ;
 	  decompactIntList (vf, oneLen(vf), li->buffer, vf->intListBytes) ;
 	}
       else
 	vcDecode (li->listCodec, vf->nBits, vf->codecBuf, li->buffer) ;
-      vf->nBits = 0 ; // so we don't do it again
+      vf->isListDecoded = true ; // so we don't do it again, but keep codecBuf for oneDNA2bit
     }
   
   return li->buffer ;
@@ -1242,9 +1375,16 @@ void *_oneCompressedList (OneFile *vf)
 {
   OneInfo *li = vf->info[(int) vf->lineType] ;
 
-  if (!vf->nBits && oneLen(vf) > 0)      // need to compress
-    vf->nBits = vcEncode (li->listCodec, oneLen(vf),
-			  vf->info[(int) vf->lineType]->buffer, vf->codecBuf);
+  if (!vf->nBits && oneLen(vf) > 0)      // need to compress, e.g. after reading ascii
+    { if (oneLen(vf) >= vf->codecBufSize)
+	{ free (vf->codecBuf) ;
+	  vf->codecBufSize = oneLen(vf) + 1 ;
+	  vf->codecBuf     = new (vf->codecBufSize, char) ;
+	}
+      vf->nBits = vcEncode (li->listCodec, oneLen(vf),
+			    vf->info[(int) vf->lineType]->buffer, vf->codecBuf);
+      vf->isListDecoded = true ; // the line buffer already holds the list
+    }
 
   return (void*) vf->codecBuf ;
 }
@@ -2197,7 +2337,99 @@ static inline void closeObjects (OneFile *vf, char t) // set count0 for any obje
 // NB in ASCII mode adds '\n' before writing line not after, so oneWriteComment() can add to line
 // first call will write initial header
 
+// Fast formatting of ascii output.  Lines are formatted into vf->asciiBuf, which is written
+// to vf->f in large blocks by asciiFlush().  Anything else that writes to vf->f for an ascii
+// file must call asciiFlush() first.
+
+#define ASCII_BLOCK_SIZE  (1 << 20)
+
+static void asciiFlush (OneFile *vf)
+{
+  if (vf->asciiBufLen)
+    { if (fwrite (vf->asciiBuf, vf->asciiBufLen, 1, vf->f) != 1)
+	die ("ONE write error: failed to write ascii block of %lld bytes", vf->asciiBufLen) ;
+      vf->asciiBufLen = 0 ;
+    }
+}
+
+static char *asciiSpace (OneFile *vf, I64 n) // returns pointer to space for n more bytes
+{
+  if (vf->asciiBufLen + n > vf->asciiBufSize)
+    { asciiFlush (vf) ;
+      if (n > vf->asciiBufSize)
+	{ if (vf->asciiBuf) free (vf->asciiBuf) ;
+	  vf->asciiBufSize = (n > ASCII_BLOCK_SIZE) ? n : ASCII_BLOCK_SIZE ;
+	  vf->asciiBuf = new (vf->asciiBufSize, char) ;
+	}
+    }
+  return vf->asciiBuf + vf->asciiBufLen ;
+}
+
+static const char digitPairs[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899" ;
+
+static inline char *formatU64 (char *s, U64 u) // writes decimal u at s, returns end
+{ char  tmp[24], *t = tmp + 24 ;
+
+  while (u >= 100)
+    { U64 q = u / 100 ;
+      t -= 2 ; memcpy (t, digitPairs + 2*(u - 100*q), 2) ;
+      u = q ;
+    }
+  if (u >= 10) { t -= 2 ; memcpy (t, digitPairs + 2*u, 2) ; }
+  else *--t = '0' + u ;
+  memcpy (s, t, tmp + 24 - t) ;
+  return s + (tmp + 24 - t) ;
+}
+
+static inline char *formatInt (char *s, I64 x) // writes " %lld"
+{
+  *s++ = ' ' ;
+  if (x < 0) { *s++ = '-' ; return formatU64 (s, -(U64)x) ; }
+  else return formatU64 (s, (U64)x) ;
+}
+
+#define REAL_FORMAT_MAX 32  // bound on the length of formatReal() output
+
+static char *formatReal (char *s, double x) // writes " %f" if that reads back as x, else " %.17g"
+{
+  *s++ = ' ' ;
+  if (x > -4e9 && x < 4e9) // here %f rounds the exact value of x to r if r/1e6 gives back x
+    { double y = x * 1e6 ;
+      I64    r = (I64) (y < 0 ? y - 0.5 : y + 0.5) ;
+      if ((double) r / 1e6 == x)
+	{ U64 u ;
+	  if (r < 0 || signbit (x)) { *s++ = '-' ; u = -(U64)r ; } else u = r ;
+	  s = formatU64 (s, u / 1000000) ;
+	  *s++ = '.' ;
+	  u %= 1000000 ;
+	  memcpy (s, digitPairs + 2*(u / 10000), 2) ;
+	  memcpy (s+2, digitPairs + 2*((u / 100) % 100), 2) ;
+	  memcpy (s+4, digitPairs + 2*(u % 100), 2) ;
+	  return s + 6 ;
+	}
+    }
+  if (isnan (x) || isinf (x))
+    return s + sprintf (s, "%f", x) ;
+  int n ;                          // else keep %f if it reads back as x, as it used to be
+  if (x > -1e15 && x < 1e15 && (n = sprintf (s, "%f", x)) && strtod (s, 0) == x)
+    return s + n ;
+  n = sprintf (s, "%.15g", x) ;    // shortest of these two that reads back as x
+  if (strtod (s, 0) != x) n = sprintf (s, "%.17g", x) ;
+  return s + n ;
+}
+
+static void writeLine (OneFile *vf, char t, I64 listLen, void *listBuf, U8 *dna2bit) ;
+
 void oneWriteLine (OneFile *vf, char t, I64 listLen, void *listBuf)
+{ writeLine (vf, t, listLen, listBuf, 0) ; }
+
+  // dna2bit is only given for a binary file with DNAcodec in use, when it holds the
+  // compressed list already, so we can write it without the encode step
+
+static void writeLine (OneFile *vf, char t, I64 listLen, void *listBuf, U8 *dna2bit)
 { I64      i, j;
   OneInfo *li;
 
@@ -2288,6 +2520,14 @@ void oneWriteLine (OneFile *vf, char t, I64 listLen, void *listBuf)
 	  
 	  if (li->fieldType[li->listField] == oneSTRING_LIST) // handle as ASCII
 	    vf->byte += writeStringList (vf, t, listLen, listBuf);
+	  else if (dna2bit)
+	    { nBits = 2*listLen ; // as returned by Compress_DNA()
+	      vf->byte += ltfWrite (nBits, vf->f) ;
+	      if (fwrite (dna2bit, ((nBits+7) >> 3), 1, vf->f) != 1)
+		die ("ONE write error: failed to write compressed list");
+	      vf->byte += ((nBits+7) >> 3) ;
+	      li->codedBytes += ((nBits+7) >> 3) ; li->plainBytes += listLen ;
+	    }
 	  else if (x & 0x1)
 	    { if (listSize >= vf->codecBufSize)
 		{ free (vf->codecBuf);
@@ -2299,6 +2539,7 @@ void oneWriteLine (OneFile *vf, char t, I64 listLen, void *listBuf)
 	      if (fwrite (vf->codecBuf, ((nBits+7) >> 3), 1, vf->f) != 1)
 		die ("ONE write error: failed to write compressed list");
 	      vf->byte += ((nBits+7) >> 3) ;
+	      li->codedBytes += ((nBits+7) >> 3) ; li->plainBytes += listSize ;
 	    }
 	  else
 	    { if (fwrite (listBuf, listSize, 1, vf->f) != 1)
@@ -2363,29 +2604,49 @@ void oneWriteLine (OneFile *vf, char t, I64 listLen, void *listBuf)
       vf->isLastLineBinary = true;
     }
 
-  // ASCII - write field by field
+  // ASCII - format field by field into vf->asciiBuf
 
   else
-    { if (!vf->isHeaderOut && !vf->isNoAsciiHeader) writeHeader (vf) ;
+    { char *s ;
+      I64   size = 2 + li->nField * (REAL_FORMAT_MAX+1) ; // bound on number of bytes to format
+
+      if (li->listEltSize > 0)
+	switch (li->fieldType[li->listField])
+	  {
+	  case oneSTRING: case oneDNA: size += listLen ; break ;
+	  case oneINT_LIST: size += listLen * 21 ; break ;
+	  case oneREAL_LIST: size += listLen * (REAL_FORMAT_MAX+1) ; break ;
+	  case oneSTRING_LIST:
+	    { char *b = (char *) listBuf ;
+	      for (j = 0 ; j < listLen ; ++j)
+		{ I64 sLen = strlen (b) ; size += 22 + sLen ; b += sLen + 1 ; }
+	    }
+	    break ;
+	  default: break ;
+	  }
+
+      if (!vf->isHeaderOut && !vf->isNoAsciiHeader && vf->share >= 0) writeHeader (vf) ; // none on slaves
 
+      s = asciiSpace (vf, size) ;
+      
       if (!vf->isLastLineBinary)      // terminate previous ascii line
-	fputc ('\n', vf->f);
+	*s++ = '\n' ;
 
       ++vf->line ; // only really needed when closing the file to see if we need to terminate it
       
-      fputc (t, vf->f);
+      *s++ = t ;
 
       for (i = 0; i < li->nField; i++)
         switch (li->fieldType[i])
 	  {
 	  case oneINT:
-            fprintf (vf->f, " %lld", vf->field[i].i);
+            s = formatInt (s, vf->field[i].i) ;
             break;
           case oneREAL:
-            fprintf (vf->f, " %f", vf->field[i].r);
+            s = formatReal (s, vf->field[i].r) ;
             break;
           case oneCHAR:
-            fprintf (vf->f, " %c", vf->field[i].c);
+            *s++ = ' ' ; *s++ = vf->field[i].c ;
             break;
           case oneSTRING:
 	  case oneDNA:
@@ -2396,48 +2657,86 @@ void oneWriteLine (OneFile *vf, char t, I64 listLen, void *listBuf)
             if (listLen > li->accum.max)
               li->accum.max = listLen;
 
-	    fprintf (vf->f, " %lld", listLen);
+	    s = formatInt (s, listLen) ;
             if (li->fieldType[i] == oneSTRING || li->fieldType[i] == oneDNA)
               { if (listLen > INT_MAX)
                   die ("ONE write error: string length %lld > current max %d", listLen, INT_MAX);
-                fprintf (vf->f, " %.*s", (int) listLen, (char *) listBuf);
+		*s++ = ' ' ;
+		memcpy (s, listBuf, listLen) ;
+		s += listLen ;
               }
             else if (li->fieldType[i] == oneINT_LIST)
               { I64 *b = (I64 *) listBuf;
                 for (j = 0; j < listLen ; ++j)
-                  fprintf (vf->f, " %lld", b[j]);
+		  s = formatInt (s, b[j]) ;
               }
             else if (li->fieldType[i] == oneREAL_LIST)
               { double *b = (double *) listBuf;
                 for (j = 0; j < listLen ; ++j)
-                  fprintf (vf->f, " %f", b[j]);
+		  s = formatReal (s, b[j]) ;
               }
             else // vSTRING_LIST
-              writeStringList (vf, t, listLen, listBuf);
+	      { char *b = (char *) listBuf ;
+		I64   sLen, totLen = 0 ;
+		for (j = 0 ; j < listLen ; ++j)
+		  { sLen = strlen (b) ;
+		    totLen += sLen ;
+		    s = formatInt (s, sLen) ;
+		    *s++ = ' ' ;
+		    memcpy (s, b, sLen) ;
+		    s += sLen ;
+		    b += sLen + 1 ;
+		  }
+		li->accum.total += totLen; // as in writeStringList()
+		if (li->accum.max < totLen)
+		  li->accum.max = totLen;
+	      }
             break;
         }
+      vf->asciiBufLen = s - vf->asciiBuf ;
       vf->isLastLineBinary = false;
     }
 }
 
-int Uncompress_DNA(char *s, int len, char *t) ; // forward declaration for temp solution below
+int Uncompress_DNA(char *s, int len, char *t) ; // forward declaration
 
 void oneWriteLineDNA2bit (OneFile *vf, char lineType, I64 len, U8 *dnaBuf) // NB len in bp
-{ // temporary solution
-  char *s = new(len, char) ;
-  Uncompress_DNA ((char*)dnaBuf, len, s) ;
-  oneWriteLine (vf, lineType, len, s) ;
-  free (s) ;
+{
+  OneInfo *li = vf->info[(int) lineType] ;
+  if (!li) die ("oneWriteLineDNA2bit() attempting to write unkown linetype %c", lineType) ;
+  if (li->fieldType[li->listField] != oneDNA)
+    die ("oneWriteLineDNA2bit() line type %c does not have a DNA list", lineType) ;
+
+  if (vf->isBinary && li->isUseListCodec && li->listCodec == DNAcodec)
+    writeLine (vf, lineType, len, 0, dnaBuf) ; // write the packed bytes as they are
+  else // ascii: need the text, so unpack into codecBuf, which ascii writing does not use
+    { if (len >= vf->codecBufSize)
+	{ free (vf->codecBuf) ;
+	  vf->codecBufSize = len + 1 ;
+	  vf->codecBuf     = new (vf->codecBufSize, char) ;
+	}
+      Uncompress_DNA ((char*)dnaBuf, len, vf->codecBuf) ;
+      writeLine (vf, lineType, len, vf->codecBuf, 0) ;
+    }
 }
 
 void oneWriteComment (OneFile *vf, char *format, ...)
 {
-  char *comment ;
-  va_list args ;
+  OneInfo *li = vf->info['/'] ; // format into the comment line buffer, not a new string
+  va_list  args ;
+  I64      len ;
 
-  va_start (args, format) ; 
-  vasprintf (&comment, format, args) ; 
+  va_start (args, format) ;
+  len = vsnprintf ((char*) li->buffer, li->bufSize, format, args) ;
   va_end (args) ;
+  if (len < 0) die ("ONE write error: failed to format comment: %s", format) ;
+  if (len >= li->bufSize)
+    { growListBuffer (li, len+1) ;
+      va_start (args, format) ;
+      vsnprintf ((char*) li->buffer, li->bufSize, format, args) ;
+      va_end (args) ;
+    }
+  char *comment = (char*) li->buffer ;
 
   if (vf->isCheckString) // then check no newlines in format
     { char *s = format ;
@@ -2445,12 +2744,13 @@ void oneWriteComment (OneFile *vf, char *format, ...)
     }
 
   if (vf->isLastLineBinary) // write a comment line
-    oneWriteLine (vf, '/', strlen(comment), comment) ;
+    oneWriteLine (vf, '/', len, comment) ;
   else // write on same line after space
-    { fputc (' ', vf->f) ;
-      fprintf (vf->f, "%s", comment) ;
+    { char *s = asciiSpace (vf, len+1) ;
+      *s++ = ' ' ;
+      memcpy (s, comment, len) ;
+      vf->asciiBufLen += len+1 ;
     }
-  free (comment) ;
 }
 
 /***********************************************************************************
@@ -2615,12 +2915,17 @@ void oneFinalizeCounts(OneFile *vf)
 
 // automatically rewrites header if allowed when writing
 
+void (*oneCloseHook) (OneFile *vf) = 0 ;
+
 void oneFileClose (OneFile *vf)
 {
   assert (vf->share >= 0) ;
 
   if (vf->isWrite)
-    {
+    { int i ;
+      for (i = 0 ; i < (vf->share ? vf->share : 1) ; ++i) // write any buffered ascii output
+	asciiFlush (vf+i) ;
+      
       if (!vf->isFinal) // RD moved this here from above - surely only needed if isWrite
 	oneFinalizeCounts (vf);
 
@@ -2633,7 +2938,8 @@ void oneFileClose (OneFile *vf)
           buf = new (10000000, char);
           pid = getpid();
           for (i = 1; i < vf->share; i++)
-            { fclose (vf[i].f);
+            { vf->line += vf[i].line; // so we terminate the last line below if only slaves wrote
+              fclose (vf[i].f);
               vf[i].f = NULL;
               sprintf(name,".part.%d.%d",pid,i);
               fid = open(name,O_RDONLY);
@@ -2654,7 +2960,8 @@ void oneFileClose (OneFile *vf)
 	  oneWriteFooter (vf);
 	}
     }
-  
+
+  if (oneCloseHook) oneCloseHook (vf) ;
   oneFileDestroy (vf);
 }
 
@@ -3452,43 +3759,29 @@ int vcEncode(OneCodec *vc, int ilen, char *ibytes, char *obytes)
 
 static char Base[4] = { 'a', 'c', 'g', 't' };
 
-int Uncompress_DNA(char *s, int len, char *t)
-{ int   i, tlen, byte;
-  char *t0, *t1, *t2, *t3;
+  //  Each 4-bit nibble is two bases, so a byte expands to two table entries
 
-  t0 = t;
-  t1 = t0+1;
-  t2 = t1+1;
-  t3 = t2+1;
+static char BasePair[16][2] =
+  { "aa", "ca", "ga", "ta", "ac", "cc", "gc", "tc",
+    "ag", "cg", "gg", "tg", "at", "ct", "gt", "tt" };
 
+int Uncompress_DNA(char *s, int len, char *t)
+{ int    i, tlen;
+  uint8 *u, byte;
+
+  u    = (uint8 *) s;
   tlen = len-3;
   for (i = 0; i < tlen; i += 4)
-    { byte = *s++;
-      t0[i] = Base[byte & 0x3];        // Base[(byte >> 6) & 0x3];
-      t1[i] = Base[(byte >> 2) & 0x3]; // Base[(byte >> 4) & 0x3];
-      t2[i] = Base[(byte >> 4) & 0x3]; // Base[(byte >> 2) & 0x3];
-      t3[i] = Base[(byte >> 6) & 0x3]; // Base[byte & 0x3];
+    { byte = *u++;
+      memcpy(t+i,BasePair[byte & 0xf],2);
+      memcpy(t+i+2,BasePair[byte >> 4],2);
     }
 
-  switch (i-tlen)
-  { case 0:
-      byte = *s++;
-      t0[i] = Base[byte & 0x3];        // Base[(byte >> 6) & 0x3];
-      t1[i] = Base[(byte >> 2) & 0x3]; // Base[(byte >> 4) & 0x3];
-      t2[i] = Base[(byte >> 4) & 0x3]; // Base[(byte >> 2) & 0x3];
-      break;
-    case 1:
-      byte = *s++;
-      t0[i] = Base[byte & 0x3];        // Base[(byte >> 6) & 0x3];
-      t1[i] = Base[(byte >> 2) & 0x3]; // Base[(byte >> 4) & 0x3];
-      break;
-    case 2:
-      byte = *s++;
-      t0[i] = Base[byte & 0x3];        // Base[(byte >> 6) & 0x3];
-      break;
-    default:
-      break;
-  }
+  if (i < len)                          // 1 to 3 bases in the last byte
+    { byte = *u;
+      for ( ; i < len; i++, byte >>= 2)
+        t[i] = Base[byte & 0x3];
+    }
 
   return (len);
 }
@@ -4054,8 +4347,8 @@ static void *myalloc(size_t size)
   p = malloc(size);
   if (p == NULL && size != 0 )
     die("ONElib myalloc failure requesting %d bytes - totalAlloc %lld", size, totalAlloc);
-  nAlloc     += 1;
-  totalAlloc += size;
+  __atomic_add_fetch (&nAlloc, 1, __ATOMIC_RELAXED);        // atomic since threads allocate
+  __atomic_add_fetch (&totalAlloc, size, __ATOMIC_RELAXED);
   return (p);
 }
 
@@ -4064,8 +4357,8 @@ static void *mycalloc(size_t number, size_t size)
 
   p = calloc(number,size);
   if (p == NULL && size > 0) die("mycalloc failure requesting %d objects of size %d", number, size);
-  nAlloc     += 1;
-  totalAlloc += size*number;
+  __atomic_add_fetch (&nAlloc, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch (&totalAlloc, size*number, __ATOMIC_RELAXED);
   return p;
 }
 
@@ -120,6 +120,8 @@ typedef struct
     char      binaryTypePack;   // binary code for line type, bit 8 set.
                                 //     bit 0: list compressed
     I64       listTack;         // accumulated training data for this threads codeCodec (master)
+    I64       codedBytes;       // list bytes through listCodec or DNA packing: coded size
+    I64       plainBytes;       //   and uncoded size, for instrumentation
   } OneInfo;
 
   // the schema type - the first record is the header spec, then a linked list of primary classes
@@ -186,6 +188,11 @@ typedef struct
     I64    codecBufSize;
     char  *codecBuf;
     I64    nBits;                  // number of bits of list currently in codecBuf
+    bool   isListDecoded;          // codecBuf list has also been decoded into the line buffer
+    char  *asciiBuf;               // ascii lines are read whole into here, or formatted here
+                                   //   for writing in blocks
+    I64    asciiBufSize;
+    I64    asciiBufLen;            // number of bytes in asciiBuf
     I64    intListBytes;           // number of bytes per integer in the compacted INT_LIST
     I64    linePos;                // current line position
     OneHeaderText *headerText;     // arbitrary descriptive text that goes with the header
@@ -377,6 +384,11 @@ void oneFileClose (OneFile *vf);
   // Close vf (opened either for reading or writing). Finalizes counts, merges theaded files,
   // and writes footer if binary. Frees all non-user memory associated with vf.
 
+extern void (*oneCloseHook) (OneFile *vf);
+
+  // If set, oneFileClose() calls this just before freeing vf, when its counts are final and
+  // vf->f is at the end of what was read or written, e.g. to collect statistics.
+
 //  GOTO & BUFFER MANAGEMENT
 
 void oneUserBuffer (OneFile *vf, char lineType, void *buffer);
@@ -6,6 +6,7 @@
  * Exported functions:
  * HISTORY:
  * Last edited: Jun 19 17:51 2024 (rd)
+ * * Oct 18 2026 (rd109): -T option for conversion in parallel threads over object ranges
  * * May 15 02:26 2024 (rd109): incorporate rd utilities so stand alone
  * Created: Thu Feb 21 22:40:28 2019 (rd109)
  *-------------------------------------------------------------------
@@ -63,6 +64,142 @@ static void transferLine (OneFile *vfIn, OneFile *vfOut, size_t *fieldSize)
   char *s = oneReadComment (vfIn) ; if (s) oneWriteComment (vfOut, "%s", s) ;
 }
 
+static void transferObjects (OneFile *vfIn, OneFile *vfOut, size_t *fieldSize,
+			     char indexType, IndexList *objList)
+{
+  while (objList)
+    { if (!oneGoto (vfIn, indexType, objList->i0))
+	die ("can't locate to object %c %lld", indexType, objList->i0 ) ;
+      if (!oneReadLine (vfIn))
+	die ("can't read object %c %lld", indexType, objList->i0) ;
+      if (objList->i0 == 0) // write up until 1st object of indexType
+	{ while (vfIn->lineType && vfIn->lineType != indexType)
+	    { transferLine (vfIn, vfOut, fieldSize) ;
+	      oneReadLine (vfIn) ;
+	    }
+	  ++objList->i0 ;
+	}
+      bool isInside = true ;
+      while (vfIn->lineType && objList->i0 < objList->iN) // lineType 0 is end of file
+	{ if (isInside) transferLine (vfIn, vfOut, fieldSize) ;
+	  oneReadLine (vfIn) ;
+	  if (!vfIn->info[(int)indexType]->contains[(int) vfIn->lineType])
+	    isInside = false ;
+	  if (vfIn->lineType == indexType)
+	    { ++objList->i0 ; isInside = true ; }
+	}
+      objList = objList->next ;
+    }
+}
+
+// transfer everything from object i0 of type T (0 for start of data) to before object iN (0 for end)
+
+static void transferRange (OneFile *vfIn, OneFile *vfOut, size_t *fieldSize,
+			   char T, I64 i0, I64 iN)
+{
+  if (!oneGoto (vfIn, T, i0)) die ("can't locate to object %c %lld", T, i0) ;
+  I64 i = i0 ? i0-1 : 0 ;
+  while (oneReadLine (vfIn))
+    { if (vfIn->lineType == T && ++i == iN) break ;
+      transferLine (vfIn, vfOut, fieldSize) ;
+    }
+}
+
+/************ parallel conversion ************/
+
+// Thread k reads from its own handle vfIn[k] and writes to vfOut[k].  ONElib concatenates the
+// slave outputs in thread order when vfOut is closed, so the ranges must be contiguous and in order.
+
+typedef struct {
+  OneFile   *vfIn, *vfOut ;
+  size_t    *fieldSize ;
+  char       T ;
+  IndexList *objList ;		// if set transfer these objects, else objects [i0,iN) of type T
+  I64        i0, iN ;
+} ThreadArg ;
+
+static void *threadTransfer (void *arg)
+{
+  ThreadArg *ta = (ThreadArg*) arg ;
+  if (ta->objList)
+    transferObjects (ta->vfIn, ta->vfOut, ta->fieldSize, ta->T, ta->objList) ;
+  else
+    transferRange (ta->vfIn, ta->vfOut, ta->fieldSize, ta->T, ta->i0, ta->iN) ;
+  return 0 ;
+}
+
+// split objList into nThreads lists covering consecutive pieces of roughly equal size
+
+static IndexList **splitIndexList (IndexList *objList, int nThreads)
+{
+  IndexList **split = new0 (nThreads, IndexList*), *ol, **tail ;
+  I64 total = 0, done = 0 ;
+  int k = 0 ;
+  
+  for (ol = objList ; ol ; ol = ol->next) total += ol->iN - ol->i0 ;
+  tail = &split[0] ;
+  for (ol = objList ; ol ; ol = ol->next)
+    { I64 i = ol->i0 ;
+      while (i < ol->iN)
+	{ I64 kEnd = (total * (k+1)) / nThreads ; // end of thread k's share, in units of done
+	  I64 n = ol->iN - i ;
+	  if (done + n > kEnd && k < nThreads-1) n = kEnd - done ;
+	  if (n > 0)
+	    { IndexList *x = new0 (1, IndexList) ;
+	      x->i0 = i ; x->iN = i + n ;
+	      *tail = x ; tail = &x->next ;
+	      i += n ; done += n ;
+	    }
+	  if (done >= kEnd && k < nThreads-1) { ++k ; tail = &split[k] ; }
+	}
+    }
+  return split ;
+}
+
+static void parallelTransfer (OneFile *vfIn, OneFile *vfOut, size_t *fieldSize, int nThreads,
+			      char indexType, IndexList *objList)
+{
+  ThreadArg *ta = new0 (nThreads, ThreadArg) ;
+  pthread_t *threads = new (nThreads, pthread_t) ;
+  IndexList **split = 0 ;
+  I64 n = 0 ;
+  int k ;
+
+  if (objList)
+    split = splitIndexList (objList, nThreads) ;
+  else
+    n = vfIn->info[(int)indexType]->given.count ;
+  
+  for (k = 0 ; k < nThreads ; ++k)
+    { ta[k].vfIn = vfIn + k ;
+      ta[k].vfOut = vfOut + k ;
+      ta[k].fieldSize = fieldSize ;
+      ta[k].T = indexType ;
+      if (objList)
+	ta[k].objList = split[k] ;
+      else
+	{ ta[k].i0 = k ? 1 + (n*k)/nThreads : 0 ;
+	  ta[k].iN = (k < nThreads-1) ? 1 + (n*(k+1))/nThreads : 0 ;
+	}
+    }
+  for (k = 1 ; k < nThreads ; ++k)
+    if ((objList && !ta[k].objList) || (!objList && ta[k].i0 == ta[k].iN && ta[k].iN))
+      ta[k].T = 0 ; // nothing to do for this thread
+    else
+      pthread_create (&threads[k], 0, threadTransfer, &ta[k]) ;
+  threadTransfer (&ta[0]) ;
+  for (k = 1 ; k < nThreads ; ++k)
+    if (ta[k].T) pthread_join (threads[k], 0) ;
+
+  if (split)
+    { for (k = 0 ; k < nThreads ; ++k)
+	while (split[k]) { IndexList *x = split[k]->next ; free (split[k]) ; split[k] = x ; }
+      free (split) ;
+    }
+  free (threads) ;
+  free (ta) ;
+}
+
 int main (int argc, char **argv)
 {
   I64 i ;
@@ -73,6 +210,7 @@ int main (int argc, char **argv)
     isBinary = false, isVerbose = false ;
   char  indexType = 0 ;
   IndexList *objList = 0 ;
+  int   nThreads = 1 ;
   
   timeUpdate (0) ;
 
@@ -89,8 +227,10 @@ int main (int argc, char **argv)
       fprintf (stderr, "  -b --binary                   write in binary (default is ascii)\n") ;
       fprintf (stderr, "  -o --output <filename>        output file name (default stdout)\n") ;
       fprintf (stderr, "  -i --index T x[-y](,x[-y])*   write specified objects/groups of type T\n") ;
+      fprintf (stderr, "  -T --threads <n>              number of threads for conversion [1]\n") ;
       fprintf (stderr, "  -v --verbose                  write commentary including timing\n") ;
       fprintf (stderr, "index only works for binary files; '-i A 0-10' outputs first 10 objects of type A\n") ;
+      fprintf (stderr, "threads only work for indexed binary input files; ascii output is identical to serial\n") ;
       exit (0) ;
     }
   
@@ -117,6 +257,10 @@ int main (int argc, char **argv)
       { outFileName = argv[1] ; argc -= 2 ; argv += 2 ; }
     else if ((!strcmp (*argv, "-i") || !strcmp (*argv, "--index")) && argc >= 3)
       { indexType = *argv[1] ; objList = parseIndexList (argv[2]) ; argc -= 3 ; argv += 3 ; }
+    else if ((!strcmp (*argv, "-T") || !strcmp (*argv, "--threads")) && argc >= 2)
+      { nThreads = atoi (argv[1]) ; argc -= 2 ; argv += 2 ;
+	if (nThreads < 1) die ("number of threads %s must be positive", argv[-1]) ;
+      }
     else die ("unknown option %s - run without arguments to see options", *argv) ;
 
   if (isBinary) isNoHeader = false ;
@@ -140,10 +284,29 @@ int main (int argc, char **argv)
 	die ("no index for line type %c", indexType) ;
     }
 
+  if (nThreads > 1 && !isWriteSchema && !isHeaderOnly)
+    { char T = indexType ;
+      if (!T && vfIn->isBinary) // split on the indexed object type with most objects
+	for (i = 'A' ; i <= 'z' ; ++i)
+	  if (vfIn->info[i] && vfIn->info[i]->index && vfIn->info[i]->given.count > 0 &&
+	      (!T || vfIn->info[i]->given.count > vfIn->info[(int)T]->given.count))
+	    T = i ;
+      if (!vfIn->isBinary || !T || !strcmp (argv[0], "-"))
+	{ if (isVerbose) fprintf (stderr, "can only use threads on indexed binary files - using 1\n") ;
+	  nThreads = 1 ;
+	}
+      else // reopen with a handle for each thread
+	{ oneFileClose (vfIn) ;
+	  vfIn = oneFileOpenRead (argv[0], vs, fileType, nThreads) ;
+	  if (!vfIn) die ("failed to reopen one file %s", argv[0]) ;
+	  indexType = T ;
+	}
+    }
+
   if (isWriteSchema)
     { oneFileWriteSchema (vfIn, outFileName) ; }
   else
-    { OneFile *vfOut = oneFileOpenWriteFrom (outFileName, vfIn, isBinary, 1) ;
+    { OneFile *vfOut = oneFileOpenWriteFrom (outFileName, vfIn, isBinary, nThreads) ;
       if (!vfOut) die ("failed to open output file %s", outFileName) ;
 
       if (isNoHeader) vfOut->isNoAsciiHeader = true ; // will have no effect if binary
@@ -155,30 +318,10 @@ int main (int argc, char **argv)
 	  for (i = 0 ; i < 128 ; ++i)
 	    if (vfIn->info[i]) fieldSize[i] = vfIn->info[i]->nField*sizeof(OneField) ;
       
-	  if (objList)
-	    while (objList)
-	      { if (!oneGoto (vfIn, indexType, objList->i0))
-		  die ("can't locate to object %c %lld", indexType, objList->i0 ) ;
-		if (!oneReadLine (vfIn))
-		  die ("can't read object %c %lld", indexType, objList->i0) ;
-		if (objList->i0 == 0) // write up until 1st object of indexType
-		  { while (vfIn->lineType && vfIn->lineType != indexType)
-		      { transferLine (vfIn, vfOut, fieldSize) ;
-			oneReadLine (vfIn) ;
-		      }
-		    ++objList->i0 ;
-		  }
-		bool isInside = true ;
-		while (vfIn->lineType && objList->i0 < objList->iN) // lineType 0 is end of file
-		  { if (isInside) transferLine (vfIn, vfOut, fieldSize) ;
-		    oneReadLine (vfIn) ;
-		    if (!vfIn->info[(int)indexType]->contains[(int) vfIn->lineType])
-		      isInside = false ;
-		    if (vfIn->lineType == indexType)
-		      { ++objList->i0 ; isInside = true ; }
-		  }
-		objList = objList->next ;
-	      }
+	  if (nThreads > 1)
+	    parallelTransfer (vfIn, vfOut, fieldSize, nThreads, indexType, objList) ;
+	  else if (objList)
+	    transferObjects (vfIn, vfOut, fieldSize, indexType, objList) ;
 	  else
 	    while (oneReadLine (vfIn))
 	      transferLine (vfIn, vfOut, fieldSize) ;
@@ -281,3 +281,303 @@ void alnWriteTrace (OneFile *of, U8 *trace, int tlen)
     trace64[j++] = trace[x];
   oneWriteLine(of,'X',j,trace64);
 }
+
+  // Interval index on the A records, so that a region can be queried via oneGoto()
+
+static char *alxSchemaText =
+  "1 3 def 1 0                 schema for interval index on .1aln files\n"
+  ".\n"
+  "P 3 alx                     ALIGNMENT INDEX\n"
+  "D s 1 3 INT                 side indexed: 0 for a, 1 for b - global\n"
+  "D n 1 3 INT                 number of alignments in the source .1aln file - global\n"
+  "O C 1 3 INT                 sequence id: following lists are sorted on start position\n"
+  "D O 1 8 INT_LIST            A object numbers in the .1aln file, 1-based\n"
+  "D B 1 8 INT_LIST            start positions\n"
+  "D E 1 8 INT_LIST            end positions\n"
+;
+
+typedef struct
+  { int seq, beg, end;
+    I64 obj;
+  } AlxRecord;
+
+static int alxOrder (const void *a, const void *b)
+{ AlxRecord *x = (AlxRecord *) a;
+  AlxRecord *y = (AlxRecord *) b;
+
+  if (x->seq != y->seq) return (x->seq - y->seq);
+  if (x->beg != y->beg) return (x->beg - y->beg);
+  return ((x->obj > y->obj) - (x->obj < y->obj));
+}
+
+static AlnIndex *alxAlloc (I64 nAln, int nSeq, bool isB)
+{ AlnIndex *ai;
+
+  ai = (AlnIndex *) calloc(1,sizeof(AlnIndex));
+  ai->isB      = isB;
+  ai->nAln     = nAln;
+  ai->nSeq     = nSeq;
+  ai->seqStart = (I64 *) calloc(nSeq+1,sizeof(I64));
+  ai->obj      = (I64 *) malloc((nAln+1)*sizeof(I64));
+  ai->beg      = (int *) malloc((nAln+1)*sizeof(int));
+  ai->end      = (int *) malloc((nAln+1)*sizeof(int));
+  ai->maxEnd   = (int *) malloc((nAln+1)*sizeof(int));
+  return ai;
+}
+
+static void alxSetMaxEnd (AlnIndex *ai)
+{ int s;
+  I64 k;
+
+  for (s = 0; s < ai->nSeq; s++)
+    for (k = ai->seqStart[s]; k < ai->seqStart[s+1]; k++)
+      if (k == ai->seqStart[s] || ai->end[k] > ai->maxEnd[k-1])
+        ai->maxEnd[k] = ai->end[k];
+      else
+        ai->maxEnd[k] = ai->maxEnd[k-1];
+}
+
+AlnIndex *alnIndexCreate (OneFile *of, bool isB)
+{ AlnIndex  *ai;
+  AlxRecord *r;
+  I64        n, nAln, k;
+  int        s, nSeq;
+
+  if (!of->isBinary || !of->info['A']->index)
+    { fprintf(stderr,"%s: Can only index binary .1aln files\n",Prog_Name);
+      return (NULL);
+    }
+
+  nAln = of->info['A']->given.count;
+  r    = (AlxRecord *) malloc((nAln+1)*sizeof(AlxRecord));
+  nSeq = 0;
+
+  if (!oneGoto(of,'A',0))
+    { fprintf(stderr,"%s: Failed to go to start of data in alnIndexCreate()\n",Prog_Name);
+      free(r);
+      return (NULL);
+    }
+  n = 0;
+  while (oneReadLine(of))
+    if (of->lineType == 'A')
+      { if (n >= nAln)
+          { fprintf(stderr,"%s: More A lines than given in header in alnIndexCreate()\n",
+                           Prog_Name);
+            free(r);
+            return (NULL);
+          }
+        r[n].obj = n+1;
+        if (isB)
+          { r[n].seq = oneInt(of,3);
+            r[n].beg = oneInt(of,4);
+            r[n].end = oneInt(of,5);
+          }
+        else
+          { r[n].seq = oneInt(of,0);
+            r[n].beg = oneInt(of,1);
+            r[n].end = oneInt(of,2);
+          }
+        if (r[n].seq >= nSeq)
+          nSeq = r[n].seq+1;
+        n += 1;
+      }
+
+  qsort(r,n,sizeof(AlxRecord),alxOrder);
+
+  ai = alxAlloc(n,nSeq,isB);
+  for (k = 0; k < n; k++)
+    { ai->obj[k] = r[k].obj;
+      ai->beg[k] = r[k].beg;
+      ai->end[k] = r[k].end;
+      ai->seqStart[r[k].seq+1] = k+1;
+    }
+  for (s = 1; s <= nSeq; s++)            // fill in sequences with no alignments
+    if (ai->seqStart[s] < ai->seqStart[s-1])
+      ai->seqStart[s] = ai->seqStart[s-1];
+  alxSetMaxEnd(ai);
+  free(r);
+
+  if (n > 0)
+    alnGoto(of,1);                     // leave of where alnOpenRead() would
+  return (ai);
+}
+
+bool alnIndexWrite (AlnIndex *ai, char *filename)
+{ OneSchema *schema;
+  OneFile   *of;
+  I64       *list;
+  I64        k, k0, k1;
+  int        s;
+
+  schema = oneSchemaCreateFromText(alxSchemaText);
+  of     = oneFileOpenWriteNew(filename,schema,"alx",true,1);
+  oneSchemaDestroy(schema);
+  if (of == NULL)
+    { fprintf(stderr,"%s: Failed to open index file %s for writing\n",Prog_Name,filename);
+      return (false);
+    }
+
+  oneInt(of,0) = ai->isB;
+  oneWriteLine(of,'s',0,0);
+  oneInt(of,0) = ai->nAln;
+  oneWriteLine(of,'n',0,0);
+
+  list = (I64 *) malloc((ai->nAln+1)*sizeof(I64));
+  for (s = 0; s < ai->nSeq; s++)
+    { k0 = ai->seqStart[s];
+      k1 = ai->seqStart[s+1];
+      if (k1 == k0)
+        continue;
+      oneInt(of,0) = s;
+      oneWriteLine(of,'C',0,0);
+      oneWriteLine(of,'O',k1-k0,ai->obj+k0);
+      for (k = k0; k < k1; k++)
+        list[k-k0] = ai->beg[k];
+      oneWriteLine(of,'B',k1-k0,list);
+      for (k = k0; k < k1; k++)
+        list[k-k0] = ai->end[k];
+      oneWriteLine(of,'E',k1-k0,list);
+    }
+  free(list);
+
+  oneFileClose(of);
+  return (true);
+}
+
+AlnIndex *alnIndexRead (char *filename)
+{ OneSchema *schema;
+  OneFile   *of;
+  AlnIndex  *ai;
+  I64       *list;
+  I64        k, len, nAln, nTot;
+  int        s, nSeq;
+  bool       isB;
+
+  schema = oneSchemaCreateFromText(alxSchemaText);
+  of     = oneFileOpenRead(filename,schema,"alx",1);
+  oneSchemaDestroy(schema);
+  if (of == NULL)
+    { fprintf(stderr,"%s: Failed to open index file %s\n",Prog_Name,filename);
+      return (NULL);
+    }
+
+  isB  = false;
+  nAln = 0;
+  nSeq = 0;
+  while (oneReadLine(of))              // first pass to find the number of sequences
+    if (of->lineType == 'C')
+      { if (oneInt(of,0) >= nSeq)
+          nSeq = oneInt(of,0)+1;
+      }
+    else if (of->lineType == 's')
+      isB = oneInt(of,0);
+    else if (of->lineType == 'n')
+      nAln = oneInt(of,0);
+
+  nTot = of->info['O']->accum.total;
+  ai   = alxAlloc(nTot,nSeq,isB);
+  ai->nAln = nAln;
+
+  oneFileClose(of);                    // and a second pass to fill the index
+  schema = oneSchemaCreateFromText(alxSchemaText);
+  of     = oneFileOpenRead(filename,schema,"alx",1);
+  oneSchemaDestroy(schema);
+
+  k = 0;
+  s = -1;
+  while (oneReadLine(of))
+    { if (of->lineType == 'C')
+        { s = oneInt(of,0);
+          continue;
+        }
+      if (of->lineType != 'O' && of->lineType != 'B' && of->lineType != 'E')
+        continue;
+      if (s < 0)
+        { fprintf(stderr,"%s: List line before any C line in index file %s\n",Prog_Name,filename);
+          goto clean_up;
+        }
+      len  = oneLen(of);
+      list = oneIntList(of);
+      if (of->lineType == 'O')
+        { if (k + len > nTot)
+            { fprintf(stderr,"%s: Index file %s is inconsistent\n",Prog_Name,filename);
+              goto clean_up;
+            }
+          memcpy(ai->obj+k,list,len*sizeof(I64));
+          ai->seqStart[s]   = k;
+          ai->seqStart[s+1] = k+len;
+          k += len;
+        }
+      else
+        { int *x = (of->lineType == 'B') ? ai->beg : ai->end;
+          I64  j, k0 = ai->seqStart[s];
+          if (k0 + len != k)
+            { fprintf(stderr,"%s: B or E line length mismatch in index file %s\n",
+                             Prog_Name,filename);
+              goto clean_up;
+            }
+          for (j = 0; j < len; j++)
+            x[k0+j] = list[j];
+        }
+    }
+  oneFileClose(of);
+
+  for (s = 1; s <= nSeq; s++)            // fill in sequences with no alignments
+    if (ai->seqStart[s] < ai->seqStart[s-1])
+      ai->seqStart[s] = ai->seqStart[s-1];
+  alxSetMaxEnd(ai);
+  return (ai);
+
+clean_up:
+  oneFileClose(of);
+  alnIndexDestroy(ai);
+  return (NULL);
+}
+
+void alnIndexDestroy (AlnIndex *ai)
+{ free(ai->seqStart);
+  free(ai->obj);
+  free(ai->beg);
+  free(ai->end);
+  free(ai->maxEnd);
+  free(ai->hits);
+  free(ai);
+}
+
+I64 alnIndexQuery (AlnIndex *ai, int seq, int beg, int end, I64 **hits)
+{ I64 lo, hi, mid, k, n;
+
+  *hits = ai->hits;
+  if (seq < 0 || seq >= ai->nSeq || end <= beg)
+    return (0);
+
+  lo = ai->seqStart[seq];             // maxEnd is non-decreasing: find first maxEnd > beg
+  hi = ai->seqStart[seq+1];
+  while (lo < hi)
+    { mid = lo + (hi-lo)/2;
+      if (ai->maxEnd[mid] > beg)
+        hi = mid;
+      else
+        lo = mid+1;
+    }
+
+  n = 0;
+  for (k = lo; k < ai->seqStart[seq+1] && ai->beg[k] < end; k++)
+    if (ai->end[k] > beg)
+      { if (n >= ai->hitMax)
+          { ai->hitMax = 2*ai->hitMax + 1024;
+            ai->hits   = (I64 *) realloc(ai->hits,ai->hitMax*sizeof(I64));
+          }
+        ai->hits[n++] = ai->obj[k];
+      }
+
+  *hits = ai->hits;
+  return (n);
+}
+
+bool alnGoto (OneFile *of, I64 i)
+{ if (!oneGoto(of,'A',i) || !oneReadLine(of) || of->lineType != 'A')
+    return (false);
+  of->info['A']->accum.count = i;     // oneGoto() counts from the object it goes to
+  return (true);
+}
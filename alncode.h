@@ -36,4 +36,34 @@ OneFile *alnOpenWrite (char *filename, int nThreads,
 void alnWriteOverlap (OneFile *of, Overlap *ovl);
 void alnWriteTrace   (OneFile *of, U8 *trace, int tlen);
 
+// interval index on the A records of a binary .1aln file, to find all alignments overlapping
+//   a region of a (or b) without scanning the whole file.  The index can be saved to a small
+//   ONE file (type "alx") next to the .1aln file and reloaded later.
+
+typedef struct {
+  bool  isB ;           // true if indexed on b coordinates, else on a
+  I64   nAln ;          // number of alignments in the source .1aln - check against nOverlaps
+  int   nSeq ;          // number of a (or b) sequences: 1 + largest id seen
+  I64  *seqStart ;      // alignments on sequence s are in [seqStart[s],seqStart[s+1]) below
+  I64  *obj ;           // A object number in the .1aln file, 1-based, for alnGoto()
+  int  *beg, *end ;     // interval of the alignment on the indexed sequence
+  int  *maxEnd ;        // running max of end within each sequence: monotonic, for binary search
+  I64  *hits ;          // buffer for alnIndexQuery() results, owned by the index
+  I64   hitMax ;
+} AlnIndex ;
+
+AlnIndex *alnIndexCreate  (OneFile *of, bool isB); // of must be binary; leaves of at first A
+bool      alnIndexWrite   (AlnIndex *ai, char *filename);
+AlnIndex *alnIndexRead    (char *filename);
+void      alnIndexDestroy (AlnIndex *ai);
+
+// find alignments overlapping [beg,end) on sequence seq: returns number found, and sets *hits to
+//   their object numbers in increasing order of start position; *hits is valid until next query
+
+I64  alnIndexQuery (AlnIndex *ai, int seq, int beg, int end, I64 **hits);
+
+// go to the i'th alignment (1-based, as in AlnIndex.obj), ready to call alnReadOverlap()
+
+bool alnGoto (OneFile *of, I64 i);
+
 // end of file
@@ -25,6 +25,34 @@ static char *gdbSchemaText =
 
 static bool isACGT[256] ;
 
+static void gdbSkeletonRead (AlnSeq *as, OneFile *of, char *gdbName) // contig offsets from the S/G/C lines
+{
+  if (!of->info['S'] || !of->info['G'] || !of->info['C'])
+    die ("GDB file %s has no S, G and C lines in its schema", gdbName) ;
+  as->nCtg = 0 ;
+  int nMax = of->info['C']->given.count ? of->info['C']->given.count : 1024 ;
+  as->ctg = new (nMax, AlnContig) ;
+  int nScaf = 0 ;
+  U64 off = 0 ;
+  while (oneReadLine (of))
+    switch (of->lineType)
+      {
+      case 'S': ++nScaf ; off = 0 ; break ;
+      case 'G': off += oneInt(of,0) ; break ;
+      case 'C':
+	if (!nScaf) die ("GDB file %s has a contig before its first scaffold", gdbName) ;
+	if (as->nCtg == nMax)
+	  { AlnContig *bigger = new (2*nMax, AlnContig) ;
+	    memcpy (bigger, as->ctg, nMax*sizeof(AlnContig)) ;
+	    free (as->ctg) ; as->ctg = bigger ; nMax *= 2 ;
+	  }
+	AlnContig *c = &as->ctg[as->nCtg++] ;
+	c->scaf = nScaf-1 ; c->off = off ; c->len = oneInt(of,0) ;
+	off += c->len ;
+	break ;
+      }
+}
+
 AlnSeq *alnSeqOpen (char *name, char *cpath, bool isIndexRequired) // open for read
 {
   { bzero (isACGT, 256*sizeof(bool)) ;
@@ -39,23 +67,34 @@ AlnSeq *alnSeqOpen (char *name, char *cpath, bool isIndexRequired) // open for r
 
   // first check whether this is a 1gdb file - if so find the parental DNA file
   OneFile *of = oneFileOpenRead (name, 0, "gdb", 1) ;
-  if (!of) of = oneFileOpenRead (fullPath, 0, "gdb", 1) ;
+  char *gdbName = name ;
+  if (!of && (of = oneFileOpenRead (fullPath, 0, "gdb", 1))) gdbName = fullPath ;
   if (of)
     { int n = of->info['<']->accum.count ; // number of reference lines
       name = 0 ;
       OneReference *r = of->reference ;
-      while (n--) if (r->count == 1) { name = r->filename ; break ; }
-      if (!name) die ("failed to find reference name in GDB file %s", fullPath) ;
+      for ( ; n-- ; ++r) if (r->count == 1) { name = r->filename ; break ; }
+      if (!name) die ("failed to find reference name in GDB file %s", gdbName) ;
+      gdbSkeletonRead (as, of, gdbName) ;
       free (fullPath) ; fullPath = new(strlen(name) + strlen(cpath) + 2, char) ;
       strcpy (fullPath, cpath) ; strcat (fullPath, "/") ; strcat (fullPath, name) ;
     }
+  else if (isIndexRequired)
+    die ("alnSeqOpen index requires a 1gdb, but %s is not one", name) ;
   
   as->si = seqIOopenRead (name, dna2textConv, false) ;
   if (!as->si) as->si = seqIOopenRead (fullPath, dna2textConv, false) ;
   if (!as->si) die ("failed to open sequence file %s or %s", name, fullPath) ;
+  if (of) oneFileClose (of) ;	// only now, because name belongs to it
+  free (fullPath) ;
 
-  if (seqIOread (as->si))
-    as->seq = sqioSeq(as->si) ;
+  if (as->si->type == ONE && !as->ctg)
+    { OneFile *vf = (OneFile*) as->si->handle ;
+      as->isRecordContig = vf->info['s'] && vf->info['s']->given.count > 0 ;
+    }
+
+  if (seqIOreadHead (as->si))
+    as->isHeadRead = true ;
   else
     { alnSeqClose (as) ;
       as = 0 ;
@@ -64,48 +103,137 @@ AlnSeq *alnSeqOpen (char *name, char *cpath, bool isIndexRequired) // open for r
   return as ;
 }
 
+static bool partNext (AlnSeq *as) // next piece of the current record, false at its end
+{
+  as->partLen = seqIOreadPart (as->si, &as->part) ;
+  as->inPart = 0 ;
+  return as->partLen > 0 ;
+}
+
 char* alnSeqNext (AlnSeq *as, U64 *len) // DNA text (acgt) for next (contig) sequence
+// Records are read in pieces, so memory goes with the longest contig, not the longest record.
+// A record starts with a contig, empty if the record starts with a gap, then after each run
+// of non-acgt there is another contig, so a trailing gap does not make an empty one.
 {
-  while (as->inSeq == as->si->seqLen)
-    { if (!seqIOread (as->si)) return 0 ;
-      as->inSeq = 0 ;
+  if (as->ctg) return (as->iCtg < as->nCtg) ? alnSeq (as, as->iCtg, len) : 0 ;
+  if (as->isRecordContig) // the record is the contig, so no need to look for gaps
+    { if (!as->isHeadRead && !seqIOreadHead (as->si)) return 0 ;
+      as->isHeadRead = false ;
+      partNext (as) ;
+      *len = as->partLen ;
+      return as->part ;
+    }
+
+  while (true) // find the start of the next contig
+    if (as->isInRecord) // skip the gap after the previous contig
+      { while (as->inPart < as->partLen && !isACGT[(int)as->part[as->inPart]]) ++as->inPart ;
+	if (as->inPart < as->partLen) break ;
+	if (!partNext (as)) as->isInRecord = false ;
+      }
+    else
+      { if (!as->isHeadRead && !seqIOreadHead (as->si)) return 0 ;
+	as->isHeadRead = false ;
+	if (partNext (as)) { as->isInRecord = true ; break ; } // else an empty record
+      }
+
+  U64 n = 0 ; // length of the contig so far in as->contig, if it spans pieces
+  while (true)
+    { char *s = as->part + as->inPart, *t = s, *tMax = as->part + as->partLen ;
+      while (t < tMax && isACGT[(int)*t]) ++t ;
+      as->inPart = t - as->part ;
+      if (t < tMax && !n) { *len = t - s ; return s ; } // usual case: within one piece
+      if (n + (t - s) > as->contigSize)
+	{ as->contigSize = 2*(n + (t - s)) ;
+	  char *c = new (as->contigSize, char) ;
+	  if (n) memcpy (c, as->contig, n) ;
+	  free (as->contig) ; as->contig = c ;
+	}
+      memcpy (as->contig + n, s, t - s) ; n += t - s ;
+      if (t < tMax) break ;
+      if (!partNext (as)) { as->isInRecord = false ; break ; }
     }
-  char *s = sqioSeq (as->si) + as->inSeq ;
-  char *t = s, *tMax = sqioSeq(as->si) + as->si->seqLen ;
-  while (t < tMax && isACGT[(int)*t]) ++t ;
-  *len = t - s ;
-  while (t < tMax && !isACGT[(int)*t]) ++t ;
-  as->inSeq = t - sqioSeq (as->si) ;
-  return s ;
+  *len = n ;
+  return as->contig ;
 }
 
 void alnSeqClose (AlnSeq *as)
 {
   seqIOclose (as->si) ;
+  free (as->contig) ;
+  if (as->ctg) free (as->ctg) ;
   free (as) ;
 }
 
-/* the next two are only supported if there is an index - not implemented yet
+/* the next two are only supported if there is a skeleton from a 1gdb */
 
-char* alnSeq (AlnSeq *as, int i, int *len) // DNA text (acgt) for i'th (contig) sequence
+static void scafGoto (AlnSeq *as, int s, bool isBack) // ready to read scaffold s from its start
 {
-  if (!as->nmax) die ("alnSeq requires index - must build with isIndexRequired true") ;
-  if (iseq != as->parent[i])
-    
+  if ((isBack || s > as->iScaf + 1) && seqIOgoto (as->si, s))
+    { if (!seqIOreadHead (as->si)) die ("failed to read scaffold %d of the sequence file", s) ;
+      as->iScaf = s ; as->partStart = as->partLen = 0 ;
+      return ;
+    }
+  if (isBack)
+    die ("alnSeq can only go back in an indexed binary sequence file: %d after %d", s, as->iScaf) ;
+  while (as->iScaf < s)
+    { while (partNext (as))	// skip the rest of the current scaffold
+	continue ;
+      if (!seqIOreadHead (as->si))
+	die ("sequence file has fewer scaffolds than its 1gdb skeleton: %d", as->iScaf+1) ;
+      ++as->iScaf ; as->partStart = as->partLen = 0 ;
+    }
 }
 
-bool alnSeqLoc (AlnSeq *as, int i, int x, int *s, int *sx) // source (scaffold) coords for 1aln i,x
+char* alnSeq (AlnSeq *as, int i, U64 *len) // DNA text (acgt) for i'th (contig) sequence
+// Direct from the skeleton offsets, so only the pieces holding the contig are looked at.
+// Within one piece it is returned in place, else copied into as->contig: either way it is
+// only valid until the next call.
 {
-  if (!as->nmax) die ("alnSeqLoc requires index - must build with isIndexRequired true") ;
-  if (i < 0 || i >= as->nseq)
-    { warn ("alnSeqLoc i %d is out of bounds [0,%d)", i, as->nseq) ; return false ; }
-  if (s) *s = as->parent[i] ;
-  if (x < 0 || x > as->len[i])
-    { warn ("alnSeqLoc pos %d is out of bounds [0,%d]", i, as->len) ; return false ; }
-  if (sx) *sx = as->offset[i] + x ;
-  return true ;
+  static char empty[1] = "" ;
+  
+  if (!as->ctg) die ("alnSeq requires index - must open a 1gdb with isIndexRequired true") ;
+  if (i < 0 || i >= as->nCtg) die ("alnSeq i %d is out of bounds [0,%d)", i, as->nCtg) ;
+  AlnContig *c = &as->ctg[i] ;
+  as->iCtg = i+1 ;
+  *len = c->len ;
+  if (!c->len) return empty ;
+
+  bool isBack = c->scaf < as->iScaf || (c->scaf == as->iScaf && c->off < as->partStart) ;
+  if (isBack || c->scaf > as->iScaf) scafGoto (as, c->scaf, isBack) ;
+  while (as->partStart + as->partLen <= c->off) // find the piece where the contig starts
+    { as->partStart += as->partLen ;
+      if (!partNext (as)) die ("contig %d is beyond the end of scaffold %d", i, c->scaf) ;
+    }
+
+  U64 x = c->off - as->partStart ;
+  if (x + c->len <= as->partLen) return as->part + x ; // usual case: within one piece
+  if (c->len > as->contigSize)
+    { free (as->contig) ;
+      as->contigSize = c->len ;
+      as->contig = new (as->contigSize, char) ;
+    }
+  U64 n = 0 ;
+  while (true)
+    { U64 k = as->partLen - x ;
+      if (n + k > c->len) k = c->len - n ;
+      memcpy (as->contig + n, as->part + x, k) ; n += k ;
+      if (n == c->len) break ;
+      as->partStart += as->partLen ; x = 0 ;
+      if (!partNext (as)) die ("contig %d is beyond the end of scaffold %d", i, c->scaf) ;
+    }
+  return as->contig ;
 }
 
-*/
+bool alnSeqLoc (AlnSeq *as, int i, U64 x, int *s, U64 *sx) // source (scaffold) coords for 1aln i,x
+{
+  if (!as->ctg) die ("alnSeqLoc requires index - must open a 1gdb with isIndexRequired true") ;
+  if (i < 0 || i >= as->nCtg)
+    { warn ("alnSeqLoc i %d is out of bounds [0,%d)", i, as->nCtg) ; return false ; }
+  if (s) *s = as->ctg[i].scaf ;
+  if (x > as->ctg[i].len)
+    { warn ("alnSeqLoc pos %llu is out of bounds [0,%llu]", x, as->ctg[i].len) ; return false ; }
+  if (sx) *sx = as->ctg[i].off + x ;
+  return true ;
+}
 
 // end of file
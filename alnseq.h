@@ -12,14 +12,33 @@
 
 #include "seqio.h"
 
+typedef struct {
+  int    scaf ;			// index of the scaffold (sequence file record) holding it
+  U64    off, len ;		// start in the scaffold and length
+} AlnContig ;			// from the S/G/C skeleton of a 1gdb
+
 typedef struct {
   SeqIO *si ;
-  char  *seq ;
-  int    inSeq ;
+  char  *part ;			// current piece of the current record, from seqIOreadPart()
+  U64    partLen, inPart ;
+  bool   isInRecord ;		// else the next contig starts a new record
+  bool   isHeadRead ;		// the header of that record has been read already
+  char  *contig ;		// copy of a contig spanning pieces, so grows to the longest
+  U64    contigSize ;
+  AlnContig *ctg ;		// skeleton if opened via a 1gdb, else 0 and contigs are found by scanning
+  int    nCtg, iCtg ;		// number of contigs, next one for alnSeqNext()
+  int    iScaf ;		// record whose pieces are being read, if ctg
+  U64    partStart ;		// offset of part in that record, if ctg
+  bool   isRecordContig ;	// 1seq with s objects: each record is one contig, gaps are 'n' lines
 } AlnSeq ;
 
 AlnSeq *alnSeqOpen (char *name, char *cpath, bool isIndexRequired) ; // open for read
 char* alnSeqNext (AlnSeq *as, U64 *len) ; // DNA text (acgt) for next (contig) sequence
 void alnSeqClose (AlnSeq *as) ;
 
+// the next two need the skeleton, so opening from a 1gdb: request with isIndexRequired true
+// alnSeq() reads forwards through the sequence file, and can only go back if it is indexed binary
+char* alnSeq (AlnSeq *as, int i, U64 *len) ; // DNA text (acgt) for i'th (contig) sequence
+bool alnSeqLoc (AlnSeq *as, int i, U64 x, int *s, U64 *sx) ; // source (scaffold) coords for 1aln i,x
+
 /******** end of file *********/
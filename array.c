@@ -36,9 +36,12 @@
 
 /********** Array : class to implement variable length arrays **********/
 
-static U64 totalAllocatedMemory = 0 ;
+static U64 totalAllocatedMemory = 0 ; /* updated atomically: threads create and extend arrays */
 static U64 totalNumberCreated = 0 ;
 static U64 totalNumberActive = 0 ;
+
+#define COUNT_ADD(x,n) __atomic_add_fetch (&(x), (n), __ATOMIC_RELAXED)
+#define COUNT_SUB(x,n) __atomic_sub_fetch (&(x), (n), __ATOMIC_RELAXED)
 static Array reportArray = 0 ;
 
 #define arrayExists(a) ((a) && (a)->magic == ARRAY_MAGIC)
@@ -57,16 +60,16 @@ Array uArrayCreate (U64 n, U64 size)
   if (size <= 0) die ("negative size %d in uArrayCreate", size) ;
   if (n < 1)
     n = 1 ;
-  totalAllocatedMemory += n * size ;
+  COUNT_ADD (totalAllocatedMemory, n * size) ;
 
   a->magic = ARRAY_MAGIC ;
   a->base = mycalloc (n, size) ;
   a->dim = n ;
   a->max = 0 ;
   a->size = size ;
-  ++totalNumberActive ;
+  COUNT_ADD (totalNumberActive, 1) ;
 #ifdef ARRAY_REPORT
-  a->id = ++totalNumberCreated ;
+  a->id = COUNT_ADD (totalNumberCreated, 1) ;
   if (reportArray)
     { if (a->id < ARRAY_REPORT_MAX)
 	array (reportArray, a->id, Array) = a ;
@@ -92,10 +95,10 @@ Array uArrayReCreate (Array a, U64 n, U64 size)
   if (n < 1) n = 1 ;
 
   if (a->dim < n || (a->dim - n)*size > (1 << 20) ) /* free if save > 1 MB */
-    { totalAllocatedMemory -= a->dim * size ;
+    { COUNT_SUB (totalAllocatedMemory, a->dim * size) ;
       free (a->base) ;
       a->dim = n ;
-      totalAllocatedMemory += a->dim * size ;
+      COUNT_ADD (totalAllocatedMemory, a->dim * size) ;
       /* base-mem isn't alloc'd on handle, it's free'd by finalisation */
       a->base = mycalloc (n, size) ;
     }
@@ -113,8 +116,8 @@ void arrayDestroy (Array a)
   if (!arrayExists (a))
     die ("arrayDestroy called on bad array %lx", (long unsigned int) a) ;
 
-  totalAllocatedMemory -= a->dim * a->size ;
-  totalNumberActive-- ;
+  COUNT_SUB (totalAllocatedMemory, a->dim * a->size) ;
+  COUNT_SUB (totalNumberActive, 1) ;
 #ifdef ARRAY_REPORT
   if (reportArray)
     arr(reportArray, a->id, Array) = 0 ;
@@ -151,7 +154,7 @@ void arrayExtend (Array a, U64 n)
   if (n < a->dim)
     return ;
 
-  totalAllocatedMemory -= a->dim * a->size ;
+  COUNT_SUB (totalAllocatedMemory, a->dim * a->size) ;
   if (a->dim*a->size < 1 << 23)	/* 8MB */
     a->dim *= 2 ;
   else
@@ -159,7 +162,7 @@ void arrayExtend (Array a, U64 n)
   if (n >= a->dim)
     a->dim = n + 1 ;
 
-  totalAllocatedMemory += a->dim * a->size ;
+  COUNT_ADD (totalAllocatedMemory, a->dim * a->size) ;
 
   new = mycalloc (a->dim, a->size) ;
   memcpy (new,a->base,a->size*a->max) ;
@@ -224,7 +227,7 @@ Array   arrayRead (FILE *f)
   a->base = myalloc (a->size*a->dim) ;
   if (fread (a->base, a->size, a->dim, f) != a->dim) { free(a) ; return 0 ; }
 #ifdef ARRAY_REPORT
-  a->id = ++totalNumberCreated ;
+  a->id = COUNT_ADD (totalNumberCreated, 1) ;
   if (reportArray)
     { if (a->id < ARRAY_REPORT_MAX)
 	array (reportArray, a->id, Array) = a ;
@@ -247,7 +250,7 @@ Array   arrayRead (FILE *f)
 /* bool arrayFind(Array a, void *s, U64 *ip, U64 (* order)(void*, void*)) */
 bool arrayFind (Array a, void *s, U64 *ip, ArrayOrder *order)
 {
-  U64 ord ;
+  int ord ;
   U64 i = 0 , j, k ;
 
   if (!arrayExists (a)) 
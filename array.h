@@ -97,6 +97,101 @@ bool    arrayRemove(Array a, void * s, ArrayOrder *order);
 bool    arrayCompress(Array a, ArrayOrder *order) ;
 bool    arrayFind(Array a, void *s, U64 *ip, ArrayOrder *order);
 
+     /* arrayPush() returns a pointer to a new element at the end, extending if necessary */
+
+static inline char *uArrayPush (Array a)
+{ if (a->max < a->dim) return a->base + (a->max++)*a->size ;
+  return uArray (a, a->max) ;
+}
+#define arrayPush(ar,type)	((type*)uArrayPush(ar))
+
+	/* Typed versions of the sorted array package, for hot loops.
+	   ARRAY_SORT_DEFINE(name,type,LT) generates static functions specialised to type,
+	   where LT(x,y) is an expression on type* x,y that is true iff *x sorts before *y.
+	   LT is expanded inline, so there is no callback per comparison as with qsort().
+	     void name##Sort (type *x, U64 n)                    introsort, not stable
+	     bool name##Find (type *x, U64 n, type *s, U64 *ip)  as arrayFind()
+	     U64  name##Compress (type *x, U64 n)                removes equal neighbours, returns new n
+	   and on Arrays of type: name##ArraySort(a), name##ArrayFind(a,s,ip), name##ArrayCompress(a)
+	*/
+
+#define ARRAY_SORT_DEFINE(name,type,LT)					\
+static inline void name##InsertSort (type *x, U64 n)			\
+{ U64 i, j ; type t ;							\
+  for (i = 1 ; i < n ; ++i)						\
+    { t = x[i] ;							\
+      for (j = i ; j > 0 && LT(&t,&x[j-1]) ; --j) x[j] = x[j-1] ;	\
+      x[j] = t ;							\
+    }									\
+}									\
+static inline void name##HeapSift (type *x, U64 i, U64 n)		\
+{ U64 c ; type t = x[i] ;						\
+  while ((c = 2*i+1) < n)						\
+    { if (c+1 < n && LT(&x[c],&x[c+1])) ++c ;				\
+      if (!LT(&t,&x[c])) break ;					\
+      x[i] = x[c] ; i = c ;						\
+    }									\
+  x[i] = t ;								\
+}									\
+static inline void name##IntroSort (type *x, U64 n, int depth)		\
+{ type t, p ;								\
+  while (n > 16)							\
+    { if (!depth--)	/* degenerate partitions: heapsort */		\
+	{ U64 i ;							\
+	  for (i = n/2 ; i-- ; ) name##HeapSift (x, i, n) ;		\
+	  for (i = n ; --i ; )						\
+	    { t = x[0] ; x[0] = x[i] ; x[i] = t ; name##HeapSift (x, 0, i) ; } \
+	  return ;							\
+	}								\
+      type *a = x, *b = x + n/2, *c = x + n-1 ;	/* median of 3, also sentinels */ \
+      if (LT(b,a)) { t = *a ; *a = *b ; *b = t ; }			\
+      if (LT(c,b))							\
+	{ t = *b ; *b = *c ; *c = t ;					\
+	  if (LT(b,a)) { t = *a ; *a = *b ; *b = t ; }			\
+	}								\
+      p = *b ;								\
+      I64 i = 0, j = n-1 ;						\
+      while (true)							\
+	{ do ++i ; while (LT(&x[i],&p)) ;				\
+	  do --j ; while (LT(&p,&x[j])) ;				\
+	  if (i >= j) break ;						\
+	  t = x[i] ; x[i] = x[j] ; x[j] = t ;				\
+	}								\
+      ++j ;			/* [0,j) <= p <= [j,n) */		\
+      if (j < n-j) { name##IntroSort (x, j, depth) ; x += j ; n -= j ; } \
+      else { name##IntroSort (x+j, n-j, depth) ; n = j ; }		\
+    }									\
+  name##InsertSort (x, n) ;						\
+}									\
+static inline void name##Sort (type *x, U64 n)				\
+{ int depth = 0 ; U64 m ;						\
+  for (m = n ; m ; m >>= 1) depth += 2 ;				\
+  name##IntroSort (x, n, depth) ;					\
+}									\
+static inline bool name##Find (type *x, U64 n, type *s, U64 *ip)	\
+{ U64 lo = 0, hi = n, mid ;						\
+  while (lo < hi)							\
+    { mid = lo + ((hi-lo) >> 1) ;					\
+      if (LT(&x[mid],s)) lo = mid+1 ; else hi = mid ;			\
+    }									\
+  if (lo < n && !LT(s,&x[lo])) { if (ip) *ip = lo ; return true ; }	\
+  if (ip) *ip = lo-1 ; /* one step left, -1 if before the start */	\
+  return false ;							\
+}									\
+static inline U64 name##Compress (type *x, U64 n)			\
+{ U64 i, j ;								\
+  if (n < 2) return n ;							\
+  for (i = 1, j = 0 ; i < n ; ++i)					\
+    if (LT(&x[j],&x[i]) && ++j != i) x[j] = x[i] ;			\
+  return j+1 ;								\
+}									\
+static inline void name##ArraySort (Array a)				\
+{ name##Sort ((type*)a->base, arrayMax(a)) ; }				\
+static inline bool name##ArrayFind (Array a, type *s, U64 *ip)		\
+{ return name##Find ((type*)a->base, arrayMax(a), s, ip) ; }		\
+static inline void name##ArrayCompress (Array a)			\
+{ arrayMax(a) = name##Compress ((type*)a->base, arrayMax(a)) ; }
+
 #ifdef ARRAY_REPORT
 	/* status and memory monitoring */
 #define ARRAY_REPORT_MAX 0	/* set to maximum number of arrays to keep track of */
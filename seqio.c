@@ -14,6 +14,7 @@
 #include "seqio.h"
 #include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #ifdef ONEIO
 #include "ONElib.h"
@@ -28,6 +29,145 @@ void bamFileClose (SeqIO *si) ;
 // global
 char* seqIOtypeName[] = { "unknown", "fasta", "fastq", "binary", "onecode", "bam" } ;
 
+/********** background decompression for gzipped input ***********/
+
+/* A producer thread inflates into one of two blocks while seqIOread() parses data
+   copied out of the other, so decompression and parsing run on different cores.
+   Only used when the input really is compressed - for plain files gzread() is just read().
+*/
+
+#define GZ_BLOCK_SIZE (1<<22)	/* 4MB per block */
+
+typedef struct {
+  gzFile gzf ;
+  pthread_t thread ;
+  pthread_mutex_t mutex ;
+  pthread_cond_t cond ;
+  char *data[2] ;
+  int   n[2] ;		/* bytes in each block, 0 at EOF, < 0 on error */
+  bool  isFull[2] ;	/* set by producer when block filled, cleared by consumer when used */
+  bool  isStop ;
+  int   in ;		/* block the consumer is reading from */
+  int   pos ;		/* consumer position in data[in] */
+} GzReader ;
+
+static void *gzReaderThread (void *arg)
+{
+  GzReader *gr = (GzReader*) arg ;
+  int i = 0 ;
+  while (true)
+    { pthread_mutex_lock (&gr->mutex) ;
+      while (gr->isFull[i] && !gr->isStop) pthread_cond_wait (&gr->cond, &gr->mutex) ;
+      bool isStop = gr->isStop ;
+      pthread_mutex_unlock (&gr->mutex) ;
+      if (isStop) break ;
+      int n = gzread (gr->gzf, gr->data[i], GZ_BLOCK_SIZE) ;
+      pthread_mutex_lock (&gr->mutex) ;
+      gr->n[i] = n ; gr->isFull[i] = true ;
+      pthread_cond_broadcast (&gr->cond) ;
+      pthread_mutex_unlock (&gr->mutex) ;
+      if (n <= 0) break ;	/* EOF or error: the consumer sees n[i] and stops there */
+      i = 1 - i ;
+    }
+  return 0 ;
+}
+
+static void gzReaderStart (SeqIO *si)
+{
+  GzReader *gr = new0 (1, GzReader) ;
+  gr->gzf = si->gzf ;
+  gr->data[0] = new (GZ_BLOCK_SIZE, char) ;
+  gr->data[1] = new (GZ_BLOCK_SIZE, char) ;
+  pthread_mutex_init (&gr->mutex, 0) ;
+  pthread_cond_init (&gr->cond, 0) ;
+  if (pthread_create (&gr->thread, 0, gzReaderThread, gr))
+    { pthread_mutex_destroy (&gr->mutex) ; pthread_cond_destroy (&gr->cond) ;
+      free (gr->data[0]) ; free (gr->data[1]) ; free (gr) ;
+      return ;			/* fall back to gzread() in this thread */
+    }
+  si->reader = gr ;
+}
+
+static void gzReaderStop (SeqIO *si) /* must call before gzclose (si->gzf) */
+{
+  GzReader *gr = (GzReader*) si->reader ;
+  if (!gr) return ;
+  pthread_mutex_lock (&gr->mutex) ;
+  gr->isStop = true ;
+  pthread_cond_broadcast (&gr->cond) ;
+  pthread_mutex_unlock (&gr->mutex) ;
+  pthread_join (gr->thread, 0) ;
+  pthread_mutex_destroy (&gr->mutex) ;
+  pthread_cond_destroy (&gr->cond) ;
+  free (gr->data[0]) ; free (gr->data[1]) ; free (gr) ;
+  si->reader = 0 ;
+}
+
+static U64 bufRead (SeqIO *si, char *b, U64 len) /* replaces gzread(), returns bytes read */
+{
+  GzReader *gr = (GzReader*) si->reader ;
+  if (!gr)
+    { int n = gzread (si->gzf, b, len) ;
+      return n > 0 ? n : 0 ;
+    }
+  U64 nRead = 0 ;
+  while (nRead < len)
+    { pthread_mutex_lock (&gr->mutex) ;
+      while (!gr->isFull[gr->in]) pthread_cond_wait (&gr->cond, &gr->mutex) ;
+      pthread_mutex_unlock (&gr->mutex) ;
+      int n = gr->n[gr->in] ;
+      if (n <= 0) break ;	/* at EOF - leave the block full so later calls also stop */
+      U64 k = n - gr->pos ;
+      if (k > len - nRead) k = len - nRead ;
+      memcpy (b + nRead, gr->data[gr->in] + gr->pos, k) ;
+      nRead += k ; gr->pos += k ;
+      if (gr->pos == n)		/* hand the block back to the producer */
+	{ pthread_mutex_lock (&gr->mutex) ;
+	  gr->isFull[gr->in] = false ;
+	  pthread_cond_broadcast (&gr->cond) ;
+	  pthread_mutex_unlock (&gr->mutex) ;
+	  gr->in = 1 - gr->in ; gr->pos = 0 ;
+	}
+    }
+  return nRead ;
+}
+
+/********** index for BINARY files ***********/
+
+/* BINARY files end with an optional index trailer: one U64 file offset per record, then
+   U64 nSeq, then the 8 characters of BINARY_INDEX_MAGIC.  The reader stops after nSeq
+   records, so older readers ignore it.  We read it with a separate file descriptor so as
+   not to disturb the gzFile.  This only works for plain (not gzipped, not stdin) files.
+*/
+
+#define BINARY_INDEX_MAGIC "seqioIDX"
+
+static void binaryIndexRead (SeqIO *si, char *filename)
+{
+  int fd = open (filename, O_RDONLY) ;
+  if (fd < 0) return ;
+  off_t end = lseek (fd, 0, SEEK_END) ;
+  U64 n, trailer = (si->nSeq+2) * sizeof(U64) ;
+  char magic[8] ;
+  if (end >= 64 + trailer && lseek (fd, end - 16, SEEK_SET) == end - 16
+      && read (fd, &n, 8) == 8 && read (fd, magic, 8) == 8
+      && n == si->nSeq && !memcmp (magic, BINARY_INDEX_MAGIC, 8)
+      && lseek (fd, end - trailer, SEEK_SET) == end - trailer)
+    { si->recOffset = new (si->nSeq ? si->nSeq : 1, U64) ;
+      if (read (fd, si->recOffset, si->nSeq*sizeof(U64)) != si->nSeq*sizeof(U64))
+	{ free (si->recOffset) ; si->recOffset = 0 ; }
+    }
+  close (fd) ;
+}
+
+static void binaryIndexWrite (SeqIO *si) /* appends trailer - call after final flush */
+{
+  U64 nBytes = si->nSeq*sizeof(U64) ;
+  if ((si->nSeq && write (si->fd, si->recOffset, nBytes) != nBytes)
+      || write (si->fd, &si->nSeq, 8) != 8 || write (si->fd, BINARY_INDEX_MAGIC, 8) != 8)
+    die ("seqio failed to write binary index") ;
+}
+
 SeqIO *seqIOopenRead (char *filename, int* convert, bool isQual)
 {
   SeqIO *si = new0 (1, SeqIO) ;
@@ -38,7 +178,8 @@ SeqIO *seqIOopenRead (char *filename, int* convert, bool isQual)
   si->b = si->buf = new (si->bufSize, char) ;
   si->convert = convert ;
   si->isQual = isQual ;
-  si->nb = gzread (si->gzf, si->buf, si->bufSize) ;
+  if (!gzdirect (si->gzf)) gzReaderStart (si) ;
+  si->nb = bufRead (si, si->buf, si->bufSize) ;
   if (!si->nb)
     { fprintf (stderr, "sequence file %s unreadable or empty\n", filename) ;
       seqIOclose (si) ;
@@ -58,7 +199,7 @@ SeqIO *seqIOopenRead (char *filename, int* convert, bool isQual)
 	    (si->buf[1] == 'R' && si->buf[2] == 'G') ||
 	    (si->buf[1] == 'P' && si->buf[2] == 'G') ||
 	    (si->buf[1] == 'C' && si->buf[2] == 'O'))) // then almost certainly a SAM file
-	{ gzclose (si->gzf) ; si->gzf = 0 ;
+	{ gzReaderStop (si) ; gzclose (si->gzf) ; si->gzf = 0 ;
 	  if (!bamFileOpenRead (filename, si))
 	    { fprintf (stderr, "failed to open file %s as SAM/BAM/CRAM\n", filename) ;
 	      seqIOclose (si) ;
@@ -87,6 +228,7 @@ SeqIO *seqIOopenRead (char *filename, int* convert, bool isQual)
       si->nb -= 64 ;
       si->seqPack = seqPackCreate (si->convert['a']) ;
       si->qualPack = qualPackCreate (si->qualThresh) ;
+      if (strcmp (filename, "-") && gzdirect (si->gzf)) binaryIndexRead (si, filename) ;
       si->seqBuf = new0 (si->maxSeqLen+1, char) ;
       if (si->isQual) si->qualBuf = new0 (si->maxSeqLen+1, char) ;
       { U64 maxBufSize = 3*sizeof(int) + 5 + si->maxIdLen + si->maxDescLen + si->maxSeqLen / 4 ;
@@ -95,13 +237,13 @@ SeqIO *seqIOopenRead (char *filename, int* convert, bool isQual)
 	  { maxBufSize = ((maxBufSize >> 20) + 1) << 20 ; /* so a clean number of megabytes */
 	    char *newBuf = new (maxBufSize, char) ; memcpy (newBuf, si->b, si->nb) ;
 	    si->b = si->buf = newBuf ; si->bufSize = maxBufSize ;
-	    si->nb += gzread (si->gzf, si->b + si->nb, si->bufSize - si->nb) ;
+	    si->nb += bufRead (si, si->b + si->nb, si->bufSize - si->nb) ;
 	  }
       }
     }
 #ifdef ONEIO
   else if (*si->buf == '1')
-    { gzclose (si->gzf) ; si->gzf = 0 ;
+    { gzReaderStop (si) ; gzclose (si->gzf) ; si->gzf = 0 ;
       OneFile *vf = oneFileOpenRead (filename, 0, "seq", 1) ;
       if (!vf)
 	{ fprintf (stderr, "failed to open ONE seq file %s\n", filename) ;
@@ -126,7 +268,7 @@ SeqIO *seqIOopenRead (char *filename, int* convert, bool isQual)
 #endif
 #ifdef BAMIO
   else
-    { gzclose (si->gzf) ; si->gzf = 0 ;
+    { gzReaderStop (si) ; gzclose (si->gzf) ; si->gzf = 0 ;
       if (!bamFileOpenRead (filename, si))
 	{ fprintf (stderr, "failed to open file %s as SAM/BAM/CRAM\n", filename) ;
 	  seqIOclose (si) ;
@@ -144,12 +286,15 @@ SeqIO *seqIOopenRead (char *filename, int* convert, bool isQual)
   return si ;
 }
 
+static void bgzfFinish (SeqIO *si) ; /* in the writing section below */
+
 void seqIOclose (SeqIO *si)
 { if (si->isWrite)
     { if (si->type <= BINARY)
 	seqIOflush (si) ;
-      if (si->type == BINARY)	/* write header */
-	{ if (lseek (si->fd, 0, SEEK_SET)) die ("failed to seek to start of binary file") ;
+      if (si->type == BINARY)	/* write index trailer, then header */
+	{ binaryIndexWrite (si) ;
+	  if (lseek (si->fd, 0, SEEK_SET)) die ("failed to seek to start of binary file") ;
 	  si->b = si->buf; 
 	  *si->b++ = 'b' ; *si->b++ = si->qualThresh ; si->b += 6 ;
 	  *(U64*)si->b = si->nSeq  ; si->b += 8 ;
@@ -165,6 +310,11 @@ void seqIOclose (SeqIO *si)
   free (si->buf) ;
   if (si->seqBuf) free (si->seqBuf) ;
   if (si->qualBuf) free (si->qualBuf) ;
+  if (si->packBuf) free (si->packBuf) ;
+  if (si->recOffset) free (si->recOffset) ;
+  if (si->runBuf) free (si->runBuf) ;
+  if (si->bgzf) bgzfFinish (si) ;
+  gzReaderStop (si) ;
   if (si->gzf) gzclose (si->gzf) ;
   if (si->fd) close (si->fd) ;
 #ifdef ONEIO
@@ -186,7 +336,7 @@ static void bufRefill (SeqIO *si)
   si->idStart -= si->recStart ; si->descStart -= si->recStart ; /* adjust all the offsets */
   si->seqStart -= si->recStart ; si->qualStart -= si->recStart ;
   si->recStart = 0 ;
-  si->nb = gzread (si->gzf, si->b, si->buf + si->bufSize - si->b) ;
+  si->nb = bufRead (si, si->b, si->buf + si->bufSize - si->b) ;
 }
 
 static void bufDouble (SeqIO *si)
@@ -195,7 +345,7 @@ static void bufDouble (SeqIO *si)
   memcpy (newbuf, si->buf, si->bufSize) ;
   si->b = newbuf + si->bufSize ; si->nb = si->bufSize ; /* rely on being at end of old buf */
   free (si->buf) ; si->buf = newbuf ;
-  si->nb = gzread (si->gzf, si->b, si->bufSize) ;
+  si->nb = bufRead (si, si->b, si->bufSize) ;
   si->bufSize *= 2 ;
 }
 
@@ -215,17 +365,99 @@ static void bufDouble (SeqIO *si)
 
 static void bufHardRefill (SeqIO *si, U64 n) /* like bufRefill() but for bufConfirmNbytes() */
 {					     /* NB buf should be big enough because of header */
-  si->b -= si->recStart ;		/* will be position after move */
-  memmove (si->buf, si->buf + si->recStart, si->b - si->buf) ;
-  si->recStart = 0 ; si->b = si->buf ;
-  si->nb += gzread (si->gzf, si->b + si->nb, si->bufSize - si->nb) ;
+  U64 used = si->b - si->buf - si->recStart ; /* part of this record already read */
+  memmove (si->buf, si->buf + si->recStart, used + si->nb) ; /* keep the unread bytes */
+  si->recStart = 0 ; si->b = si->buf + used ;
+  si->nb += bufRead (si, si->b + si->nb, si->bufSize - used - si->nb) ;
   if (si->nb < n) die ("incomplete sequence record %" PRIu64 "", si->line) ;
 }
 
 #define bufConfirmNbytes(si, n) { if (si->nb < n) bufHardRefill (si, n) ; }
 
+/* block scanning: rather than stepping bufAdvanceInRecord() byte by byte, find record
+   and line boundaries with memchr() over everything in the buffer, which the C library
+   does many bytes at a time, and only call bufRefill()/bufDouble() when that runs out
+*/
+
+static bool bufMore (SeqIO *si) /* call when si->nb == 0 inside a record; false at EOF */
+{
+  if (si->recStart) bufRefill (si) ;
+  else if (si->b == si->buf + si->bufSize) bufDouble (si) ;
+  return si->nb > 0 ;
+}
+
+static bool bufFindChar (SeqIO *si, char c) /* move si->b to next c, false if EOF first */
+{
+  while (true)
+    { char *p = memchr (si->b, c, si->nb) ;
+      if (p) { si->nb -= p - si->b ; si->b = p ; return true ; }
+      si->b += si->nb ; si->nb = 0 ;
+      if (!bufMore (si)) return false ;
+    }
+}
+
+static bool bufFindRecordStart (SeqIO *si) /* move si->b to next '>' at line start or EOF */
+{					    /* false if file ends without a final '\n' */
+  if (*si->b == '>') return true ;	    /* empty sequence: the header '\n' is now 0 */
+  while (true)
+    { char *p = memchr (si->b, '>', si->nb) ;
+      if (p && p[-1] == '\n') { si->nb -= p - si->b ; si->b = p ; return true ; }
+      if (p) { si->nb -= p+1 - si->b ; si->b = p+1 ; continue ; } /* '>' inside a line */
+      si->b += si->nb ; si->nb = 0 ;
+      if (!bufMore (si)) return si->b[-1] == '\n' ;
+    }
+}
+
+static char *convertStrip (int *convert, char *s, char *e, U64 *nLines)
+{ /* convert [s,e) in place, dropping characters that map to < 0; returns new end */
+  char *t = s ;
+  U64   n = 0 ;
+  while (s < e)
+    { int c = convert[(int)*s] ;
+      n += (*s++ == '\n') ;
+      *t = c ; t += (c >= 0) ;	/* branch-free: always write, only advance if kept */
+    }
+  *nLines = n ;
+  return t ;
+}
+
+static void packText (SeqIO *si) /* for isPacked on text input: pack sqioSeq() into packBuf */
+{
+  U64 nBytes = (si->seqLen+3)/4 ;
+  if (nBytes > si->packBufSize)
+    { if (si->packBuf) free (si->packBuf) ;
+      si->packBufSize = 2*nBytes ;
+      si->packBuf = new (si->packBufSize, U8) ;
+    }
+  seqPack (si->seqPack, sqioSeq(si), si->packBuf, si->seqLen) ;
+  si->packed = si->packBuf ;
+}
+
 #include <ctype.h>
 
+static bool readTextHeader (SeqIO *si) /* FASTA or FASTQ: id and desc, leave b at line 2 */
+{
+  if (si->type == FASTA)
+    { if (*si->b != '>') die ("no initial > for FASTA record line %" PRIu64 "", si->line) ; }
+  else if (si->type == FASTQ)
+    { if (*si->b != '@') die ("no initial @ for FASTQ record line %" PRIu64 "", si->line) ; }
+  bufAdvanceInRecord(si) ; si->idStart = si->b - si->buf ;
+  while (!isspace(*si->b)) bufAdvanceInRecord(si) ;
+  si->idLen = si->b - sqioId(si) ;
+  if (*si->b != '\n') /* a space or tab - whatever follows on this line is description */
+    { *si->b = 0 ; bufAdvanceInRecord(si) ;
+      si->descStart = si->b - si->buf ;
+      if (!bufFindChar (si, '\n'))
+	{ fprintf (stderr, "incomplete sequence record line %" PRIu64 "\n", si->line) ; return false ; }
+      si->descLen = si->b - sqioDesc(si) ;
+    }
+  else { si->descLen = si->descStart = 0 ; }
+  *si->b = 0 ;
+  ++si->line ; bufAdvanceInRecord(si) ;	              /* line 2 */
+  si->seqStart = si->b - si->buf ;
+  return true ;
+}
+
 bool seqIOread (SeqIO *si)
 {
 #ifdef ONEIO
@@ -239,7 +471,11 @@ bool seqIOread (SeqIO *si)
 	  si->seqBuf = new0 (si->maxSeqLen+1, char) ;
 	  if (si->isQual) si->qualBuf = new0 (si->maxSeqLen+1, char) ;
 	}
-      if (si->convert)
+      if (si->isPacked) /* copy out: codecBuf is overwritten by the lines read below */
+	{ memcpy (si->seqBuf, oneDNA2bit(vf), (si->seqLen+3)/4) ;
+	  si->packed = (U8*) si->seqBuf ;
+	}
+      else if (si->convert)
 	{ char *s = si->seqBuf, *e = s + si->seqLen, *sv = oneString(vf) ;
 	  while (s < e) *s++ = si->convert[(int)*sv++] ;
 	}
@@ -262,7 +498,7 @@ bool seqIOread (SeqIO *si)
 	      si->descStart = si->idLen+1 ;
 	      if (desc) strcpy (si->buf+si->descStart, desc) ; else si->buf[si->descStart] = 0 ;
 	    }
-	  if (vf->lineType == 'N')
+	  if (vf->lineType == 'N' && !si->isPacked) /* packed maps non-acgt to a anyway */
 	    { int n = oneInt(vf,2) ;
 	      char base = si->convert ? si->convert[(int)oneChar(vf,1)] : oneChar(vf,1) ;
 	      while (n--) si->seqBuf[oneInt(vf,0)+n] = base ;
@@ -272,7 +508,11 @@ bool seqIOread (SeqIO *si)
     }
 #endif
 #ifdef BAMIO
-  if (si->type == BAM) return bamRead (si) ;
+  if (si->type == BAM)
+    { if (!bamRead (si)) return false ;
+      if (si->isPacked) packText (si) ;
+      return true ;
+    }
 #endif
 
   if (!si->nb) return false ;
@@ -292,7 +532,10 @@ bool seqIOread (SeqIO *si)
       si->idStart = si->b - si->buf ;
       si->descStart = si->idStart + si->idLen + 1 ;
       si->seqStart = si->descStart + si->descLen + 1 ;
-      seqUnpack (si->seqPack, (U8*)(si->buf+si->seqStart), si->seqBuf, 0, si->seqLen) ;
+      if (si->isPacked)		/* zero-copy: point straight into the read buffer */
+	si->packed = (U8*)(si->buf+si->seqStart) ;
+      else
+	seqUnpack (si->seqPack, (U8*)(si->buf+si->seqStart), si->seqBuf, 0, si->seqLen) ;
       if (si->isQual)
 	{ si->qualStart = si->seqStart + (si->seqLen + 3) / 4 ;
 	  qualUnpack (si->qualPack, (U8*)(si->buf+si->qualStart), si->qualBuf, si->seqLen) ;
@@ -304,34 +547,17 @@ bool seqIOread (SeqIO *si)
   
   /* if get to here then this is a text file, FASTA or FASTQ */
   
+  if (!readTextHeader (si)) return false ;
   if (si->type == FASTA)
-    { if (*si->b != '>') die ("no initial > for FASTA record line %" PRIu64 "", si->line) ; }
-  else if (si->type == FASTQ)
-    { if (*si->b != '@') die ("no initial @ for FASTQ record line %" PRIu64 "", si->line) ; }
-  bufAdvanceInRecord(si) ; si->idStart = si->b - si->buf ;
-  while (!isspace(*si->b)) bufAdvanceInRecord(si) ;
-  si->idLen = si->b - sqioId(si) ;
-  if (*si->b != '\n') /* a space or tab - whatever follows on this line is description */
-    { *si->b = 0 ; bufAdvanceInRecord(si) ;
-      si->descStart = si->b - si->buf ;
-      while (*si->b != '\n') bufAdvanceInRecord(si) ;
-      si->descLen = si->b - sqioDesc(si) ;
-    }
-  else { si->descLen = si->descStart = 0 ; }
-  *si->b = 0 ;
-  ++si->line ; bufAdvanceInRecord(si) ;	              /* line 2 */
-  si->seqStart = si->b - si->buf ;
-  if (si->type == FASTA)
-    { while (si->nb && *si->b != '>')
-	{ while (*si->b != '\n') bufAdvanceInRecord(si) ;
-	  ++si->line ; bufAdvanceEndRecord(si) ;
-	}
-      char *s = sqioSeq(si), *t = s ;
-      while (s < si->b) if ((*t++ = si->convert[(int)*s++]) < 0) --t ;
+    { U64 nLines ;
+      bool isComplete = bufFindRecordStart (si) ;
+      char *t = convertStrip (si->convert, sqioSeq(si), si->b, &nLines) ;
+      si->line += nLines ;
+      if (!isComplete) goto incomplete ;
       si->seqLen = t - sqioSeq(si) ;
     }
   else if (si->type == FASTQ)
-    { while (*si->b != '\n') bufAdvanceInRecord(si) ;
+    { if (!bufFindChar (si, '\n')) goto incomplete ;
       si->seqLen = si->b - sqioSeq(si) ;
       if (si->convert)
 	{ char *s = sqioSeq(si) ;
@@ -339,22 +565,212 @@ bool seqIOread (SeqIO *si)
 	}
       ++si->line ; bufAdvanceInRecord(si) ; 	      /* line 3 */
       if (*si->b != '+') die ("missing + FASTQ line %" PRIu64 "", si->line) ;
-      while (*si->b != '\n') bufAdvanceInRecord(si) ; /* ignore remainder of + line */
+      if (!bufFindChar (si, '\n')) goto incomplete ; /* ignore remainder of + line */
       ++si->line ; bufAdvanceInRecord(si) ;	      /* line 4 */
       si->qualStart = si->b - si->buf ;
-      while (*si->b != '\n') bufAdvanceInRecord(si) ;
+      if (!bufFindChar (si, '\n')) goto incomplete ;
       if (si->b - si->buf - si->qualStart != si->seqLen)
 	die ("qual not same length as seq line %" PRIu64 "", si->line) ;
       if (si->isQual) { char *q = sqioQual(si), *e = q + si->seqLen ; while (q < e) *q++ -= 33 ; }
       ++si->line ; bufAdvanceEndRecord(si) ;
     }
 
+  if (si->isPacked) packText (si) ;
   ++si->nSeq ;
   return true ;
+
+ incomplete:
+  fprintf (stderr, "incomplete sequence record line %" PRIu64 "\n", si->line) ;
+  return false ;
+}
+
+bool seqIOreadHead (SeqIO *si)
+{
+  if (si->type != FASTA) return (si->isInPart = seqIOread (si)) ;
+  if (!si->nb) return false ;
+  si->recStart = si->b - si->buf ;
+  if (!readTextHeader (si)) return false ;
+  si->seqLen = 0 ;
+  si->partLast = '\n' ;		/* the raw character before b */
+  si->isInPart = true ;
+  return true ;
+}
+
+U64 seqIOreadPart (SeqIO *si, char **seq)
+{
+  if (si->type != FASTA)	/* the whole sequence, once */
+    { if (!si->isInPart) return 0 ;
+      si->isInPart = false ;
+      *seq = sqioSeq(si) ;
+      return si->seqLen ;
+    }
+
+  while (si->isInPart)
+    { if (!si->nb)		/* refill from the start of buf: earlier parts are finished with */
+	{ si->recStart = si->b - si->buf ;
+	  bufRefill (si) ;
+	  if (!si->nb) { si->isInPart = false ; ++si->nSeq ; break ; }
+	}
+      char *s = si->b, *e = s + si->nb, *p = s ; /* the record ends at a '>' at a line start */
+      while ((p = memchr (p, '>', e - p)) && (p == s ? si->partLast : p[-1]) != '\n') ++p ;
+      if (p) { si->isInPart = false ; ++si->nSeq ; } else p = e ;
+      if (p > s) si->partLast = p[-1] ;
+      si->b = p ; si->nb -= p - s ;
+      U64 nLines ;
+      char *t = convertStrip (si->convert, s, p, &nLines) ;
+      si->line += nLines ;
+      if (t > s) { si->seqLen += t - s ; *seq = s ; return t - s ; }
+    }
+  return 0 ;
+}
+
+bool seqIOgoto (SeqIO *si, U64 k)
+{
+  if (si->type != BINARY || si->isWrite || !si->recOffset || k > si->nSeq) return false ;
+  U64 off = (k < si->nSeq) ? si->recOffset[k] : 64 ; /* k == nSeq: read() will return false */
+  if (gzseek (si->gzf, off, SEEK_SET) != off) return false ;
+  si->recStart = 0 ;
+  si->b = si->buf ;
+  si->nb = bufRead (si, si->buf, si->bufSize) ;
+  si->line = k+1 ;		/* for BINARY line counts records from 1 */
+  return true ;
 }
 
 /*********************** open for writing ***********************/
 
+static U8 packConv[] = {    /* sends N (indeed any non-CGT) to A, except 0,1,2,3 are maintained */
+   0,   1,   2,   3,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0, 
+   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0, 
+   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0, 
+   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0, 
+   0,   0,   0,   1,   0,   0,   0,   2,   0,   0,   0,   0,   0,   0,   0,   0,
+   0,   0,   0,   0,   3,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+   0,   0,   0,   1,   0,   0,   0,   2,   0,   0,   0,   0,   0,   0,   0,   0,
+   0,   0,   0,   0,   3,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0
+} ;
+
+/* Gzipped output is written as BGZF: a series of independent gzip members, each holding
+   up to BGZF_BLOCK_SIZE bytes of text, with the BC extra field giving the member size.
+   Any gzip reader, including seqIOopenRead(), sees one stream; htslib tools can also
+   index it.  Because blocks are independent, each seqIOflush() deflates its blocks on
+   seqIOthreads() worker threads and then writes them in order.
+*/
+
+#define BGZF_BLOCK_SIZE  0xff00	/* so a stored (level 0) block still fits in 64k */
+#define BGZF_MAX_SIZE    0x10000
+#define BGZF_HEADER_SIZE 18
+#define BGZF_FOOTER_SIZE 8
+
+static int seqIOnThreads = 1 ;
+void seqIOthreads (int nThreads) { seqIOnThreads = nThreads > 0 ? nThreads : 1 ; }
+
+typedef struct {
+  int   nThreads ;
+  z_stream *z ;		/* one per thread */
+  U8   *out ;		/* BGZF_MAX_SIZE per block */
+  int  *outLen ;
+  int   maxBlocks ;
+  char *in ;		/* the text being compressed in this flush */
+  U64   inLen ;
+  int   nBlocks ;
+} BgzfWriter ;
+
+typedef struct {
+  BgzfWriter *w ;
+  int t ;		/* thread number */
+} BgzfThreadArg ;
+
+static BgzfWriter *bgzfCreate (void)
+{
+  BgzfWriter *w = new0 (1, BgzfWriter) ;
+  w->nThreads = seqIOnThreads ;
+  w->z = new0 (w->nThreads, z_stream) ;
+  int t ;
+  for (t = 0 ; t < w->nThreads ; ++t) /* raw deflate: we write our own gzip wrapper */
+    if (deflateInit2 (&w->z[t], Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+      die ("seqio failed to initialise deflate") ;
+  return w ;
+}
+
+static void bgzfCompressBlock (z_stream *z, char *in, int inLen, U8 *out, int *outLen)
+{
+  static const U8 header[BGZF_HEADER_SIZE] =
+    { 0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0, 0, 0 } ;
+  int level ;
+  for (level = Z_DEFAULT_COMPRESSION ; ; level = 0) /* fall back to stored if data expands */
+    { deflateReset (z) ;
+      if (level == 0) deflateParams (z, 0, Z_DEFAULT_STRATEGY) ;
+      z->next_in = (U8*) in ; z->avail_in = inLen ;
+      z->next_out = out + BGZF_HEADER_SIZE ;
+      z->avail_out = BGZF_MAX_SIZE - BGZF_HEADER_SIZE - BGZF_FOOTER_SIZE ;
+      if (deflate (z, Z_FINISH) == Z_STREAM_END) break ;
+      if (level == 0) die ("seqio BGZF block failed to compress") ;
+    }
+  if (level == 0) deflateParams (z, Z_DEFAULT_COMPRESSION, Z_DEFAULT_STRATEGY) ;
+  int n = BGZF_HEADER_SIZE + z->total_out + BGZF_FOOTER_SIZE ;
+  memcpy (out, header, BGZF_HEADER_SIZE) ;
+  out[16] = (n-1) & 0xff ; out[17] = (n-1) >> 8 ; /* BSIZE = total block size - 1 */
+  U32 crc = crc32 (crc32 (0, 0, 0), (U8*) in, inLen) ;
+  U8 *f = out + BGZF_HEADER_SIZE + z->total_out ;
+  f[0] = crc ; f[1] = crc >> 8 ; f[2] = crc >> 16 ; f[3] = crc >> 24 ;
+  f[4] = inLen ; f[5] = inLen >> 8 ; f[6] = inLen >> 16 ; f[7] = inLen >> 24 ;
+  *outLen = n ;
+}
+
+static void *bgzfThread (void *arg)
+{
+  BgzfWriter *w = ((BgzfThreadArg*)arg)->w ;
+  int i, t = ((BgzfThreadArg*)arg)->t ;
+  for (i = t ; i < w->nBlocks ; i += w->nThreads)
+    { U64 start = (U64)i * BGZF_BLOCK_SIZE ;
+      int len = (w->inLen - start < BGZF_BLOCK_SIZE) ? w->inLen - start : BGZF_BLOCK_SIZE ;
+      bgzfCompressBlock (&w->z[t], w->in + start, len, w->out + (U64)i*BGZF_MAX_SIZE, &w->outLen[i]) ;
+    }
+  return 0 ;
+}
+
+static void bgzfWrite (BgzfWriter *w, int fd, char *buf, U64 len)
+{
+  if (!len) return ;
+  w->in = buf ; w->inLen = len ;
+  w->nBlocks = (len + BGZF_BLOCK_SIZE - 1) / BGZF_BLOCK_SIZE ;
+  if (w->nBlocks > w->maxBlocks)
+    { if (w->out) { free (w->out) ; free (w->outLen) ; }
+      w->maxBlocks = w->nBlocks ;
+      w->out = new ((U64)w->maxBlocks * BGZF_MAX_SIZE, U8) ;
+      w->outLen = new (w->maxBlocks, int) ;
+    }
+
+  int t, nThreads = (w->nThreads < w->nBlocks) ? w->nThreads : w->nBlocks ;
+  pthread_t *threads = new (nThreads, pthread_t) ;
+  BgzfThreadArg *args = new (nThreads, BgzfThreadArg) ;
+  for (t = 0 ; t < nThreads ; ++t) { args[t].w = w ; args[t].t = t ; }
+  for (t = 1 ; t < nThreads ; ++t) pthread_create (&threads[t], 0, bgzfThread, &args[t]) ;
+  bgzfThread (&args[0]) ;	/* this thread does its share */
+  for (t = 1 ; t < nThreads ; ++t) pthread_join (threads[t], 0) ;
+  free (threads) ; free (args) ;
+
+  int i ;
+  for (i = 0 ; i < w->nBlocks ; ++i)
+    if (write (fd, w->out + (U64)i*BGZF_MAX_SIZE, w->outLen[i]) != w->outLen[i])
+      die ("seqio BGZF write error") ;
+}
+
+static void bgzfFinish (SeqIO *si) /* writes the standard empty EOF block, frees writer */
+{
+  BgzfWriter *w = (BgzfWriter*) si->bgzf ;
+  static const U8 eofBlock[28] =
+    { 0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0, 0x1b, 0,
+      3, 0, 0, 0, 0, 0, 0, 0, 0, 0 } ;
+  if (write (si->fd, eofBlock, 28) != 28) die ("seqio BGZF write error") ;
+  int t ;
+  for (t = 0 ; t < w->nThreads ; ++t) deflateEnd (&w->z[t]) ;
+  free (w->z) ;
+  if (w->out) { free (w->out) ; free (w->outLen) ; }
+  free (w) ;
+  si->bgzf = 0 ;
+}
+
 SeqIO *seqIOopenWrite (char *filename, SeqIOtype type, int* convert, int qualThresh)
 {
   SeqIO *si = new0 (1, SeqIO) ;
@@ -417,19 +833,17 @@ SeqIO *seqIOopenWrite (char *filename, SeqIOtype type, int* convert, int qualThr
       if (si->fd == -1) { warn ("failed to write to stdout") ; free (si) ; return 0 ; }
     }
   else if (!strcmp (filename, "-z"))
-    { si->gzf = gzdopen (fileno(stdout), "w") ;
-      if (!si->gzf) { warn ("failed to gzdopen stdout", filename) ; free (si) ; return 0 ; }
-    }
-  else if (isGzip)
-    { si->gzf = gzopen (filename, "w") ;
-      if (!si->gzf) { warn ("failed to gzopen %s", filename) ; free (si) ; return 0 ; }
+    { si->fd = fileno (stdout) ;
+      if (si->fd == -1) { warn ("failed to write to stdout") ; free (si) ; return 0 ; }
+      isGzip = true ;
     }
   else
     { si->fd = open (filename, O_CREAT | O_TRUNC | O_WRONLY, 00644) ;
       if (si->fd == -1) { warn ("failed to open %s", filename) ; free (si) ; return 0 ; }
     }
-  if (si->type == BINARY && si->gzf)
-    { fprintf (stderr, "can't write a gzipped binary file\n") ; seqIOclose (si) ; return 0 ; }
+  if (si->type == BINARY && isGzip)
+    { fprintf (stderr, "can't write a gzipped binary file\n") ; close (si->fd) ; free (si) ; return 0 ; }
+  if (isGzip) si->bgzf = bgzfCreate () ;
   
   si->nb = si->bufSize = 1<<24 ;
   si->b = si->buf = new (si->bufSize, char) ;
@@ -469,9 +883,10 @@ void seqIOflush (SeqIO *si)	/* writes buffer to file and resets to 0 */
 {
   if (!si->isWrite) return ;
   U64 retVal, nBytes = si->b - si->buf ;
-  if (si->gzf) retVal = gzwrite (si->gzf, si->buf, nBytes) ;
+  if (si->bgzf) { bgzfWrite ((BgzfWriter*)si->bgzf, si->fd, si->buf, nBytes) ; retVal = nBytes ; }
   else retVal = write (si->fd, si->buf, nBytes) ;
   if (retVal != nBytes) die ("seqio write error %" PRIu64 " not %" PRIu64 " bytes written", retVal, nBytes) ;
+  si->fileOffset += nBytes ;
   si->b = si->buf ;
   si->nb = si->bufSize ;
 }
@@ -500,37 +915,56 @@ void seqIOwrite (SeqIO *si, char *id, char *desc, U64 seqLen, char *seq, char *q
 #ifdef ONEIO
   if (si->type == ONE)
     { OneFile *vf = (OneFile*)(si->handle) ;
-      static U64 bufLen = 0 ;
-      static char *buf = 0 ;
-      static char idBuf[16] ;
-      I64 i ;
-      if (seqLen > bufLen)
-	{ if (buf) free (buf) ;
-	  bufLen = seqLen ;
-	  buf = new(bufLen+1,char) ;
+      U64 i, nRun = 0 ;
+      if ((seqLen+3)/4 > si->packBufSize)
+	{ if (si->packBuf) free (si->packBuf) ;
+	  si->packBufSize = (seqLen+3)/4 + (seqLen+3)/8 ;
+	  si->packBuf = new (si->packBufSize, U8) ;
 	}
-      if (si->convert)
-	{ for (i = 0 ; i < seqLen ; ++i) buf[i] = si->convert[(int)(seq[i])] ;
-	  seq = buf ;
+      /* one pass: convert, pack 2-bit, and collect runs of non-acgt as (pos, base, len) */
+      U8 *u = si->packBuf, byte = 0 ;
+      for (i = 0 ; i < seqLen ; ++i)
+	{ int c = si->convert ? si->convert[(int)seq[i]] : seq[i] ;
+	  if (c < 0) c = 'n' ;	/* not a valid base for this converter */
+	  byte |= packConv[c] << (2*(i & 3)) ;
+	  if ((i & 3) == 3) { *u++ = byte ; byte = 0 ; }
+	  if (!acgtCheck[c])
+	    { U64 *r = nRun ? si->runBuf + 3*(nRun-1) : 0 ;
+	      if (r && r[0] + r[2] == i && r[1] == c) ++r[2] ; /* extends the last run */
+	      else
+		{ if (3*(nRun+1) > si->runBufSize)
+		    { U64 newSize = 2*si->runBufSize + 3*1024 ;
+		      resize (si->runBuf, si->runBufSize, newSize, U64) ;
+		      si->runBufSize = newSize ;
+		    }
+		  r = si->runBuf + 3*nRun++ ;
+		  r[0] = i ; r[1] = c ; r[2] = 1 ;
+		}
+	    }
 	}
-      oneWriteLine (vf, 'S', seqLen, seq) ;
+      if (i & 3) *u = byte ;
+      oneWriteLineDNA2bit (vf, 'S', seqLen, si->packBuf) ;
       if (id)
-	{ oneWriteLine (vf, 'I', strlen (id), id) ;
+	{ oneWriteLine (vf, 'I', si->idLen, id) ;
 	  if (desc) oneWriteComment (vf, "%s", desc) ;
 	}
       if (qual && si->isQual)
-	{ for (i = 0 ; i < seqLen ; ++i) buf[i] = qual[i] + 33 ;
-	  oneWriteLine (vf, 'Q', seqLen, buf) ;
+	{ if (seqLen > si->seqBufSize)
+	    { if (si->seqBuf) free (si->seqBuf) ;
+	      si->seqBufSize = seqLen + seqLen/2 ;
+	      si->seqBuf = new (si->seqBufSize, char) ;
+	    }
+	  char *q = si->seqBuf ;
+	  for (i = 0 ; i < seqLen ; ++i) q[i] = qual[i] + 33 ;
+	  oneWriteLine (vf, 'Q', seqLen, q) ;
+	}
+      for (i = 0 ; i < nRun ; ++i) // write exceptions for non-ACGT characters
+	{ U64 *r = si->runBuf + 3*i ;
+	  oneInt(vf,0) = r[0] ;
+	  oneChar(vf,1) = r[1] ;
+	  oneInt(vf,2) = r[2] ;
+	  oneWriteLine (vf, 'N', 0, 0) ;
 	}
-      for (i = 0 ; i < seqLen ; ++i) // write exceptions for non-ACGT characters
-	if (!acgtCheck[seq[i]])
-	  { oneInt(vf,0) = i ;
-	    char c = oneChar(vf,1) = seq[i] ;
-	    I64 n = 1 ;
-	    while (++i < seqLen && seq[i] == c) n++ ;
-	    oneInt(vf,2) = n ;
-	    oneWriteLine (vf, 'N', 0, 0) ;
-	  }
       return ;
     }
 #endif
@@ -547,6 +981,14 @@ void seqIOwrite (SeqIO *si, char *id, char *desc, U64 seqLen, char *seq, char *q
     }
   if (len > si->nb) seqIOflush (si) ;
   if (len > si->nb) writeExtend (si, len) ;
+  if (si->type == BINARY)	/* record offset for the index */
+    { if (si->nSeq > si->recOffsetSize)
+	{ U64 newSize = 2*si->recOffsetSize + (1<<16) ;
+	  resize (si->recOffset, si->recOffsetSize, newSize, U64) ;
+	  si->recOffsetSize = newSize ;
+	}
+      si->recOffset[si->nSeq-1] = si->fileOffset + (si->b - si->buf) ;
+    }
 
   if (si->type == FASTA)
     { *si->b++ = '>' ;
@@ -589,12 +1031,13 @@ void seqIOwrite (SeqIO *si, char *id, char *desc, U64 seqLen, char *seq, char *q
 
 /********* reverse complement sequences ********/
 
-char* seqRevComp (char* s, U64 len) // index and text (including ambig) 
+char* seqRevComp (char* s, char *r, U64 len) // index and text (including ambig)
 {
-  char *r = new(len,char) ;
+  if (!r) r = new(len,char) ;
+  char *r0 = r ;
   r += len ;
   while (len--) *--r = complementBase[(int)*s++] ;
-  return r ;
+  return r0 ;
 }
 
 /********** some routines to pack sequence and qualities for binary representation ***********/
@@ -621,16 +1064,6 @@ SeqPack *seqPackCreate (char unpackA)
   return sp ;
 }
 
-static U8 packConv[] = {    /* sends N (indeed any non-CGT) to A, except 0,1,2,3 are maintained */
-   0,   1,   2,   3,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0, 
-   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0, 
-   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0, 
-   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0, 
-   0,   0,   0,   1,   0,   0,   0,   2,   0,   0,   0,   0,   0,   0,   0,   0,
-   0,   0,   0,   0,   3,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
-   0,   0,   0,   1,   0,   0,   0,   2,   0,   0,   0,   0,   0,   0,   0,   0,
-   0,   0,   0,   0,   3,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0
-} ;
 
 U8* seqPack (SeqPack *sp, char *s, U8 *u, U64 len) /* compress s into (len+3)/4 u */
 {
@@ -678,140 +1111,125 @@ char* seqUnpack (SeqPack *sp, U8 *u, char *s, U64 i, U64 len)
   return s0 ;
 }
 
-U8 *seqRevCompPacked (U8* u, U8 *rc, U64 len)
+/* Word loads of 32 packed bases starting at any base offset, used by seqRevCompPacked()
+   and seqMatchPacked().  Loads are little-endian, as elsewhere in SeqPack.
+   packedLoad32() reads up to 9 bytes from the current byte, so use it only when at least
+   36 bases remain; packedLoadN() loads exactly the bytes holding the bases it returns.
+*/
+
+static inline U64 packedLoad32 (U8 *u, U64 i) /* bases i..i+31 - needs 36 bases valid */
 {
-  if (!rc) rc = new(len,U8) ;
-  U64 i ;
-  static U8 rcByte[256] ;
-  static bool isFirst = true ;
-  if (isFirst)
-    { for (i = 0 ; i < 256 ; ++i)
-	rcByte[255-i] = ((i & 3) << 6) | ((i & 12) << 2) | ((i & 48) >> 2) | ((i & 192) >> 6) ;
-      isFirst = false ;
-    }
+  U8 *p = u + (i >> 2) ;
+  int s = 2*(i & 3) ;
+  U64 w ;
+  memcpy (&w, p, 8) ;
+  if (s) w = (w >> s) | ((U64)p[8] << (64 - s)) ;
+  return w ;
+}
+
+static inline U64 packedLoadN (U8 *u, U64 i, int n) /* bases i..i+n-1 for 0 < n <= 32 */
+{
+  U8 *p = u + (i >> 2) ;
+  int s = 2*(i & 3) ;
+  int nBytes = (s + 2*n + 7) >> 3 ;	/* 1..9 */
+  U64 w = 0 ;
+  if (nBytes <= 8)
+    { memcpy (&w, p, nBytes) ; w >>= s ; }
+  else				/* n == 32 and s > 0 */
+    { memcpy (&w, p, 8) ; w = (w >> s) | ((U64)p[8] << (64 - s)) ; }
+  if (n < 32) w &= ((U64)1 << 2*n) - 1 ;
+  return w ;
+}
+
+static inline U64 revCompWord (U64 w) /* reverse complement 32 packed bases */
+{
+  w = __builtin_bswap64 (w) ;	/* reverse the bytes, then the 4 bases in each byte */
+  w = ((w >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((w & 0x0f0f0f0f0f0f0f0fULL) << 4) ;
+  w = ((w >> 2) & 0x3333333333333333ULL) | ((w & 0x3333333333333333ULL) << 2) ;
+  return ~w ;			/* complement of x in 0..3 is 3-x */
+}
 
-  U64 blen = (len+3)/4 ;
+U8 *seqRevCompPacked (U8* u, U8 *rc, U64 len)
+{
   if (!rc) rc = new((len+3)/4,U8) ;
-  for (i = blen ; i-- ;) rc[i] = rcByte[*u++] ;
-  switch (len % 4) // now shift back
-    {
-    case 0:
-      break ;
-    case 1:
-      for (i = 0 ; i < blen-1 ; ++i) rc[i] = (rc[i] >> 6) | (rc[i+1] << 2) ;
-      rc[blen-1] = rc[blen-1] >> 6 ;
-      break ;
-    case 2:
-      for (i = 0 ; i < blen-1 ; ++i) rc[i] = (rc[i] >> 4) | (rc[i+1] << 4) ;
-      rc[blen-1] = rc[blen-1] >> 4 ;
-      break ;
-    case 3:
-      for (i = 0 ; i < blen-1 ; ++i) rc[i] = (rc[i] >> 2) | (rc[i+1] << 6) ;
-      rc[blen-1] = rc[blen-1] >> 2 ;
-      break ;
+  U64 j, w ;			/* output bases j..j+31 are input bases len-32-j..len-1-j */
+  for (j = 0 ; j + 32 <= len ; j += 32)
+    { U64 i = len - 32 - j ;
+      w = (i + 36 <= len) ? packedLoad32 (u, i) : packedLoadN (u, i, 32) ;
+      w = revCompWord (w) ;
+      memcpy (rc + (j >> 2), &w, 8) ;
+    }
+  if (j < len)			/* remaining n < 32 output bases come from input 0..n-1 */
+    { int n = len - j ;
+      w = revCompWord (packedLoadN (u, 0, n)) >> (64 - 2*n) ;
+      memcpy (rc + (j >> 2), &w, (n+3)/4) ;
     }
-  
   return rc ;
 }
 
-U64 seqMatchPacked2 (U8 *a, U64 ia, U8 *b, U64 ib, U64 len) /* returns 0 or distance to mismatch */
+U64 seqMatchPacked (U8 *a, U64 ia, U8 *b, U64 ib, U64 len)
 {
-  static SeqPack *sp = 0 ;
-  if (sp == 0) sp = seqPackCreate ('a') ;
-  U64 i = 0 ;
-  char *sa = seqUnpack (sp, a, 0, ia, len), *sb = seqUnpack (sp, b, 0, ib, len) ;
-  while (i < len && sa[i] == sb[i]) i++ ;
-  free (sa) ; free (sb) ;
-  if (i == len) return 0 ; else return i+1 ;
+  U64 x, d = 0 ;		/* d is number of bases matched so far */
+
+  while (len >= 36)
+    { x = packedLoad32 (a, ia) ^ packedLoad32 (b, ib) ;
+      if (x) return d + (__builtin_ctzll (x) >> 1) + 1 ;
+      ia += 32 ; ib += 32 ; d += 32 ; len -= 32 ;
+    }
+  while (len)
+    { int n = (len < 32) ? len : 32 ;
+      x = packedLoadN (a, ia, n) ^ packedLoadN (b, ib, n) ;
+      if (x) return d + (__builtin_ctzll (x) >> 1) + 1 ;
+      ia += n ; ib += n ; d += n ; len -= n ;
+    }
+  return 0 ;			/* all match */
 }
 
-U64 seqMatchPacked (U8 *a, U64 ia, U8 *b, U64 ib, U64 len)
+static inline U64 mismatchBits (U64 x) /* one bit, at the low bit of each base, per mismatch */
+{ return (x | (x >> 1)) & 0x5555555555555555ULL ; }
+
+U64 seqHammingPacked (U8 *a, U64 ia, U8 *b, U64 ib, U64 len)
 {
-  static SeqPack *sp ;
-  static U64 mask[33] ; // need 1 to 32
-  static bool isFirst = true ;
-  int i, chunk = 0 ;
-  if (isFirst) // initialise statics
-    { sp = seqPackCreate ('a') ;
-      union { U64 u ; U8 b[8] ; } z ;
-      z.u = 0 ;
-      for (i = 0 ; i < 8 ; i++)
-	{ z.b[i] = 0x03 ; mask[4*i+1] = z.u ;
-	  z.b[i] = 0x0f ; mask[4*i+2] = z.u ;
-	  z.b[i] = 0x3f ; mask[4*i+3] = z.u ;
-	  z.b[i] = 0xff ; mask[4*i+4] = z.u ;
-	}
-      isFirst = false ;
-    }
-
-  // advance sequences to the 64-bit words in which the start points begin
-  // recall that a U64 holds 32 bases, (z & 0x1f) == z % 32, and (z >> 5) == z / 32
-  U64 *ua = &(((U64*)a)[ia>>5]), *ub = &(((U64*)b)[ib>>5]) ;
-  ia &= 0x1f ; ib &= 0x1f ;
-
-  // debug
-  int iia = ia, iib = ib, ilen = len ;
-  char sa[16], sb[16] ; sa[15] = sb[15] = 0 ;
-  int l = (len < 15) ? len : 15 ;
-  a = (U8*) ua ; b = (U8*) ub ;
-  seqUnpack (sp, a, sa, ia, l) ; seqUnpack (sp, b, sb, ib, l) ;
-  U64 d2 = seqMatchPacked2 (a, ia, b, ib, len) ;
-  char ca, cb ; if (d2) { seqUnpack (sp, a, &ca, d2-1, 1) ; seqUnpack (sp, b, &cb, d2-1, 1) ; }
-
-  U64 uua = 0, uub = 0, d = 0 ; // distance of match
-  if (len > 32) // can work in 64-bit words
-    { if (ia == ib)
-	{ if (((*ua++ >> (2*ia)) & mask[32-ia]) != ((*ub++ >> (2*ib)) & mask[32-ib]))
-	    { d = 32 - ia ;
-	      goto end ;
-	    }
-	  d += (32 - ia) ; len -= (32 - ia) ;
-	  while (len > 32)
-	    { d += 32 ; len -= 32 ;
-	      uua = *ua ; uub = *ub ; // DEBUG
-	      if ((*ua++ & mask[32]) != (*ub++ & mask[32])) goto end ;
-	    }
-	}
-      else
-	{ if (ib < ia) { U64 *t = ua ; ua = ub ; ub = t ; U64 it = ia ; ia = ib ; ib = it ; }
-	  uua = *ua >> (2*ia) ; uub = *ub >> (2*ib) ;
-	  while (len > 32)
-	    { chunk = 32-ib ; d += chunk ; len -= chunk ;
-	      if ((uua & mask[chunk]) != (uub & mask[chunk])) goto end ;
-	      uua >>= 2*chunk ; ia += chunk ; uub = *++ub ; ib = 0 ;
-	      chunk = 32-ia ; d += chunk ; len -= chunk ;
-	      if ((uua & mask[chunk]) != (uub & mask[chunk])) goto end ;
-	      uub >>= 2*chunk ; ib += chunk ; uua = *++ua ; ia = 0 ; 
-	    }
-	}
+  U64 x, d = 0 ;		/* d is number of mismatches */
+
+  while (len >= 36)
+    { x = packedLoad32 (a, ia) ^ packedLoad32 (b, ib) ;
+      d += __builtin_popcountll (mismatchBits (x)) ;
+      ia += 32 ; ib += 32 ; len -= 32 ;
     }
-  
-  // final bases which may not fit into a 32 bit word
-  char abuf[33], bbuf[33] ;
-  seqUnpack (sp, (U8*)ua, abuf, ia, len) ; seqUnpack (sp, (U8*)ub, bbuf, ib, len) ;
-  for (i = 0 ; i < len ; ++i)
-    { ++d ;
-      if (abuf[i] != bbuf[i])
-	{ abuf[len] = bbuf[len] = 0 ;
-	  if (d2 != d)
-	    printf ("SEQMATCH ia %d ib %d len %d d %" PRId64 " d2 %" PRId64 " abuf %s bbuf %s i %d\n",
-		    iia, iib, ilen, d, d2, abuf, bbuf, i) ;
-	  return d ;
-	}
+  while (len)
+    { int n = (len < 32) ? len : 32 ;
+      x = packedLoadN (a, ia, n) ^ packedLoadN (b, ib, n) ;
+      d += __builtin_popcountll (mismatchBits (x)) ;
+      ia += n ; ib += n ; len -= n ;
     }
-  if (d2)
-    printf ("SEQMATCH ia %d ib %d len %d d %" PRId64 " d2 %" PRId64 " abuf %s bbuf %s i %d ca %c cb %c\n",
-	    iia, iib, ilen, d, d2, abuf, bbuf, i, ca, cb) ;
-  d = 0 ; // if we get here then they all match
+  return d ;
+}
 
- end:
-  if ((!d2 && d) || (d != d2 && d+32 < d2))
-    { printf ("seqMatch ia %d ib %d len %d d %" PRId64 " d2 %" PRId64 " a %s b %s\n",
-	      iia, iib, ilen, d, d2, sa, sb) ;
-      printf ("   local d %" PRId64 "  uua %0" PRIx64 " uub %0" PRIx64 " chunk %d mask[chunk] %0" PRIx64 "\n",
-	      d, uua, uub, chunk, mask[chunk]) ;
+U64 seqExtendPacked (U8 *a, U64 ia, U8 *b, U64 ib, U64 len, int xDrop, U64 *nMis)
+{
+  I64 score = 0, best = 0 ;
+  U64 x, d = 0, nm = 0, bestLen = 0, bestMis = 0 ;
+
+  while (len)			/* the score can only reach a new best just before a mismatch */
+    { int p, prev = 0, n = (len < 32) ? len : 32 ;
+      x = (len >= 36) ? packedLoad32 (a, ia) ^ packedLoad32 (b, ib)
+		      : packedLoadN (a, ia, n) ^ packedLoadN (b, ib, n) ;
+      for (x = mismatchBits (x) ; x ; x &= x - 1)
+	{ p = __builtin_ctzll (x) >> 1 ;
+	  score += p - prev ;
+	  if (score > best) { best = score ; bestLen = d + p ; bestMis = nm ; }
+	  score -= 3 ; ++nm ;
+	  if (best - score > xDrop) goto done ;
+	  prev = p + 1 ;
+	}
+      score += n - prev ;
+      if (score > best) { best = score ; bestLen = d + n ; bestMis = nm ; }
+      ia += n ; ib += n ; d += n ; len -= n ;
     }
-  return d ;
+ done:
+  if (nMis) *nMis = bestMis ;
+  return bestLen ;
 }
 
 /************ QualPack package ***************/
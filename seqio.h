@@ -37,6 +37,10 @@ char*    seqUnpack (SeqPack *sp, U8 *u, char *s, U64 i, U64 len) ;
 U8*      seqRevCompPacked (U8 *u, U8 *rc, U64 len) ; /* reverse complements 2-bit packed binary */
 U64      seqMatchPacked (U8 *a, U64 ia, U8 *b, U64 ib, U64 len) ;
 		/* returns 0 if match, index+1 of first mismatching site if mismatch */
+U64      seqHammingPacked (U8 *a, U64 ia, U8 *b, U64 ib, U64 len) ; /* number of mismatches */
+U64      seqExtendPacked (U8 *a, U64 ia, U8 *b, U64 ib, U64 len, int xDrop, U64 *nMis) ;
+		/* ungapped X-drop extension scoring match +1, mismatch -3: returns the length
+		   of the best scoring prefix, and its number of mismatches in *nMis if non-zero */
 
 /* QualPack is similar for 1-bit qualities, mapping q < qualThresh to 0, q >= qualThresh to 1 */
 
@@ -62,6 +66,7 @@ typedef struct {
   U64   idLen, descLen, seqLen ;
   U64   idStart, descStart, seqStart, qualStart ;
   bool  isQual ;       		/* if set then convert qualities by subtracting 33 (FASTQ) */
+  bool  isPacked ;		/* if set after opening, read sequences 2-bit packed - see below */
   int   qualThresh ;		/* used for binary representation of qualities */
   /* below here private */
   U64   bufSize ;
@@ -72,7 +77,20 @@ typedef struct {
   char *buf, *b ;		/* b is current pointer in buf */
   int  *convert ;
   char *seqBuf, *qualBuf ;	/* used in modes BINARY, VGP, BAM */
+  U8   *packed ;		/* packed sequence if isPacked */
+  U8   *packBuf ;		/* used for isPacked with FASTA, FASTQ, BAM, and writing ONE */
+  U64   packBufSize ;
+  U64   seqBufSize ;		/* when writing ONE, seqBuf holds qualities */
+  U64  *runBuf ;		/* (pos, base, len) of non-acgt runs when writing ONE */
+  U64   runBufSize ;
+  U64  *recOffset ;		/* BINARY record offsets in file, if indexed */
+  U64   recOffsetSize ;		/* allocated size of recOffset when writing */
+  U64   fileOffset ;		/* bytes flushed so far when writing */
+  bool  isInPart ;		/* between seqIOreadHead() and the end of its seqIOreadPart()s */
+  char  partLast ;		/* last raw character of the previous part */
   void *handle;			/* used for ONEseq, BAM */
+  void *reader ;		/* background decompression thread for gzipped input */
+  void *bgzf ;			/* block compressor for gzipped output */
   SeqPack  *seqPack ;
   QualPack *qualPack ;
 } SeqIO ;
@@ -89,7 +107,30 @@ bool seqIOread (SeqIO *si) ;
 #define sqioSeq(si)  ((si)->type >= BINARY ? (si)->seqBuf : (si)->buf+(si)->seqStart)
 #define sqioQual(si) ((si)->type >= BINARY ? (si)->qualBuf : (si)->buf+(si)->qualStart)
 
+/* If you set si->isPacked after opening then sqioSeqPacked() gives the sequence in SeqPack
+   2-bit form, (seqLen+3)/4 bytes.  For BINARY this points directly into the read buffer and
+   for ONE it is the oneDNA2bit() data, so in both cases no text is made, and sqioSeq() is
+   not valid.  For text formats the text is read as usual and then packed.
+*/
+#define sqioSeqPacked(si) ((si)->packed)
+
+/* For FASTA records too long to hold, seqIOreadHead() reads just the id and desc of the next
+   record, and then seqIOreadPart() returns its sequence in consecutive pieces, converted like
+   sqioSeq(), and 0 at the end of the record.  Each piece points into the read buffer and is
+   valid until the next call.  The buffer is not grown to hold the record, so memory stays at
+   the buffer size, but sqioId() and sqioDesc() are only valid until the first piece is read.
+   si->seqLen counts the bases so far.  Other types read the whole record in seqIOreadHead(),
+   and give it as a single piece.  Not for isPacked.
+*/
+bool seqIOreadHead (SeqIO *si) ;
+U64  seqIOreadPart (SeqIO *si, char **seq) ;
+
+bool seqIOgoto (SeqIO *si, U64 k) ; /* next read is sequence k (0-based) - BINARY only */
+	/* needs the index written by seqIOclose(), so not for old files, gzip or stdin;
+	   to split a file for parallel processing open it once per thread and seqIOgoto() */
+
 void seqIOreferenceFileName (char *refFileName) ; /* resets this (globally) for CRAM */
+void seqIOthreads (int nThreads) ; /* sets (globally) threads for compressing .gz output */
 
 SeqIO *seqIOopenWrite (char *filename, SeqIOtype type, int* convert, int qualThresh) ;
 void seqIOwrite (SeqIO *si, char *id, char *desc, U64 seqLen, char *seq, char *qual) ;
@@ -113,7 +154,8 @@ SeqIO *seqIOadoptOneFile (void *handle, int* convert, int qualThresh) ;
 
 /* utility */
 
-char* seqRevComp (char *s, U64 len) ; /* reverse complements both index and text encodings */
+char* seqRevComp (char *s, char *r, U64 len) ; /* reverse complements both index and text */
+		/* encodings into r if non-zero else allocates memory, like seqPack() */
 
 /* standard converters - instantiated in seqio.c */
 
@@ -10,6 +10,9 @@
  *-------------------------------------------------------------------
  */
 
+#include <pthread.h>
+#include <unistd.h>		// for access()
+
 #include "utils.h"
 #include "array.h"
 #include "alncode.h" // includes ONElib.h and align.h
@@ -29,14 +32,23 @@ static char* schemaText =
   "S 2 sv                    SEQUENCE VARIANT\n"
   "D o 1 3 INT               maximum overhang (global)\n"
   "D i 1 3 INT               maximum insert size (global)\n"
+  "D t 1 3 INT               breakpoint tolerance for merging calls (global)\n"
+  "D f 1 6 STRING            input .1aln file, one line per sample in order, if more than one\n"
+  "D x 1 6 STRING            after each f line: its a_file, with its c_path\n"
+  "D y 1 6 STRING            after each f line: its b_file, with its c_path, if it has one\n"
   ".                         \n"
   "O V 3 3 INT 3 INT 3 INT   variant: seqid, start, end (0-indexed, [start,end))\n"
   "D O 1 3 INT               overlap\n"
   "D B 3 3 INT 3 INT 3 INT   source, start-match, end-match\n"
+  "D N 1 3 INT               number of supporting alignment pairs, merged within the tolerance\n"
+  "D F 1 3 INT               sample: index of the input .1aln file in the f lines\n"
   "D D 1 3 DNA               target site duplication (TSD): sequence\n"
   "D R 2 3 INT 3 INT         Terminal Inverted Repeat (TIR): length, number of mismatches\n"
   "D T 2 3 INT 3 INT         Long Terminal direct Repeat (LTR): length, number of mismatches\n"
   "G S                       insertions group sequences\n"
+  "O U 3 3 INT 3 INT 3 INT   duplication: seqid, start, end of the extra (second) copy\n"
+  "D C 3 3 INT 3 INT 3 INT   source, start, end of the single copy\n"
+  "G S                       duplications group sequences\n"
   ".\n"
   "O S 1 3 DNA               sequence of the insertion\n"
   "D I 1 6 STRING            identifier of the insertion\n"
@@ -44,14 +56,38 @@ static char* schemaText =
 
 static int MAX_OVERHANG = 50 ;
 static int MAX_SIZE = 50000 ;
+static int NTHREADS = 1 ;
+
+static int MIN_TSD = 4 ;		// target site duplication length range
+static int MAX_TSD = 50 ;
+static int MIN_TIR = 15 ;		// minimum terminal inverted repeat length
+static int MIN_LTR = 50 ;		// minimum long terminal repeat length
+static int MAX_LTR_DIFF = 20 ;		// maximum LTR mismatch percentage
+static int X_DROP = 20 ;		// for TIR extension, scoring match +1, mismatch -3
+static int CHAIN_LOOKBACK = 50 ;	// predecessors considered in chaining chainless files
+static int CHAIN_GAP_DIV = 2 ;		// chaining gap cost is indel / this + unaligned or overlap
+static bool isSweep = false ;		// test all pairs within MAX_SIZE rather than chains
+static int MERGE_TOL = 10 ;		// calls with all breakpoints this close are merged
+static int nInputs = 1 ;		// number of .1aln files given
+static bool isNoSeq = false ;		// write variant records only, without sequences
+
+#define SEED 16				// exact seed length for LTR search
+#define NSEED 3				// number of seeds at each end for LTR search
+#define SLOP 3				// uncertainty in element ends for TIR, LTR search
 
 void usage (void)
 {
-  fprintf (stderr, "Usage: svfind [opts] <1alnFileName>\n") ;
+  fprintf (stderr, "Usage: svfind [opts] <1alnFileName>+\n") ;
   fprintf (stderr, "opts:     -w <int>         maximum overhang\n") ;
   fprintf (stderr, "          -m <int>         maximum length\n") ;
   fprintf (stderr, "          -a <filename>    outfile for insertions/duplications in a\n") ;
   fprintf (stderr, "          -b <filename>    outfile for insertions/duplications in b\n") ;
+  fprintf (stderr, "          -T <int>         number of threads [%d]\n", NTHREADS) ;
+  fprintf (stderr, "          -s               test all alignment pairs, not just consecutive ones in chains\n") ;
+  fprintf (stderr, "          -n               no sequences: skip reading them, annotation and S lines\n") ;
+  fprintf (stderr, "          -t <int>         merge calls with breakpoints within this tolerance [%d]\n", MERGE_TOL) ;
+  fprintf (stderr, "          -p <int>         report progress to stderr every <int> seconds\n") ;
+  fprintf (stderr, "          -j <filename>    write phase times and counters as JSON\n") ;
   
   exit (1) ;
 }
@@ -65,14 +101,231 @@ static inline void flip (Overlap *o1, Overlap *o2) // must be safe for o2 == o1
   t = o1->path.aepos ; o2->path.aepos = o1->path.bepos ; o2->path.bepos = t ; 
 }
 
-static int overlapOrder (const void *x, const void *y) // sort on b, a, bbpos
-{ Overlap *ox = (Overlap*)x, *oy = (Overlap*)y ;
-  int c = ox->bread - oy->bread ; if (c) return c ;
-  c = ox->aread - oy->aread ; if (c) return c ;
-  c = ox->path.bbpos - oy->path.bbpos ; return c ;
+#define OVERLAP_LT(x,y) /* sort on b, a, bbpos */				\
+  ((x)->bread < (y)->bread || ((x)->bread == (y)->bread &&		\
+   ((x)->aread < (y)->aread || ((x)->aread == (y)->aread &&		\
+    (x)->path.bbpos < (y)->path.bbpos))))
+ARRAY_SORT_DEFINE(overlap, Overlap, OVERLAP_LT)
+
+typedef struct {
+  int a, a_begin, a_end ;
+  int b, b_match_begin, b_match_end ;
+  int lo, hi ;			// a[lo,hi) = [a_begin,a_end) plus flanks is stored in the sequence pool
+  U64 pool ;			// offset of a[lo] in the pool, which is a ring: it is at pool % size
+  int tsdBegin, tsdLen ;	// target site duplication a[tsdBegin,tsdBegin+tsdLen)
+  int tirLen, tirMis ;		// terminal inverted repeat of the inserted element
+  int ltrLen, ltrMis ;		// long terminal direct repeat of the inserted element
+  bool isDup ;			// a[a_begin,a_end) is a second copy of b[b_match_begin,b_match_end)
+  int nSupport ;		// number of alignment pairs merged into this call
+  int sample ;			// index of the input it came from
+} Insertion ;
+
+#define INSERTION_LT(x,y) /* complete sort on the call, before merging */	\
+  ((x)->a < (y)->a || ((x)->a == (y)->a &&				\
+   ((x)->a_begin < (y)->a_begin || ((x)->a_begin == (y)->a_begin &&	\
+    ((x)->a_end < (y)->a_end || ((x)->a_end == (y)->a_end &&		\
+     ((x)->isDup < (y)->isDup || ((x)->isDup == (y)->isDup &&		\
+      ((x)->sample < (y)->sample || ((x)->sample == (y)->sample &&	\
+       ((x)->b < (y)->b || ((x)->b == (y)->b &&				\
+	((x)->b_match_begin < (y)->b_match_begin ||			\
+	 ((x)->b_match_begin == (y)->b_match_begin &&			\
+	  (x)->b_match_end < (y)->b_match_end))))))))))))))
+ARRAY_SORT_DEFINE(insertion, Insertion, INSERTION_LT)
+
+I64  variantFind (Overlap *olap, int n, Array insA, Array insB) ; // all return pairs tested
+I64  variantFindChains (Overlap *olap, int *chain, int n, Array insA, Array insB) ;
+I64  variantFindDP (Overlap *olap, int n, Array insA, Array insB) ;
+void insertionReport (OneFile *of, AlnSeq *as, Array a) ;
+
+/********************* instrumentation *********************/
+
+static void oneStats (OneFile *vf)
+// oneCloseHook: count the bytes, lines of each type and list codec sizes of each ONE file
+{
+  char  name[64], *type = vf->subType ? vf->subType : vf->fileType ;
+  char *dir = vf->isWrite ? "written" : "read" ;
+  I64   coded = 0, plain = 0 ;
+  int   t, i ;
+
+  snprintf (name, 64, "%s bytes %s", type, dir) ;
+  statsAdd (name, ftello (vf->f)) ;
+  for (t = 'A' ; t <= 'z' ; ++t)
+    if ((t <= 'Z' || t >= 'a') && vf->info[t])
+      { if (vf->info[t]->accum.count)
+	  { snprintf (name, 64, "%s %c lines %s", type, t, dir) ;
+	    statsAdd (name, vf->info[t]->accum.count) ;
+	  }
+	for (i = 0 ; i < (vf->share ? vf->share : 1) ; ++i) // threaded writes have a file per thread
+	  { coded += vf[i].info[t]->codedBytes ; plain += vf[i].info[t]->plainBytes ; }
+      }
+  if (plain)
+    { snprintf (name, 64, "%s list bytes %s coded", type, dir) ; statsAdd (name, coded) ;
+      snprintf (name, 64, "%s list bytes %s uncoded", type, dir) ; statsAdd (name, plain) ;
+    }
 }
 
-void insertionReport (OneFile *of, AlnSeq *as, Overlap *olap, int n) ;
+/********************* processing several inputs *********************/
+
+typedef struct {
+  char    *fileName ;
+  OneFile *of ;
+  I64      nOverlaps ;
+  char    *db1Name, *db2Name, *cpath ;
+  char    *source1, *source2 ;	// db1Name, db2Name resolved against cpath: these key the sources
+  int      sample ;		// index of this input, written in F lines if nInputs > 1
+  Array    insA, insB ;		// its variants in a and in b
+} Input ;
+
+typedef struct {
+  Input *in ;
+  int    next ;			// next input to process, taken atomically
+} InputPool ;
+
+static void inputProcess (Input *in)
+// read the overlaps of one input, find its variants, and label them with its sample
+{
+  I64      i, nOverlaps = in->nOverlaps ;
+  OneFile *ofIn = in->of ;
+  Overlap *olaps = new (nOverlaps, Overlap) ;
+  int     *chain = new (2*nOverlaps, int) ; // chain ('a' object) number, 0 if none
+  int      nChains ;
+  I64      nPairs ;
+  for (i = 0 ; i < nOverlaps ; ++i)
+    { chain[i] = ofIn->info['a']->accum.count ; // 'a' line precedes its first alignment
+      alnReadOverlap (ofIn, olaps+i) ;
+      alnSkipTrace (ofIn) ;
+      if ((i & 0xfffff) == 0xfffff) statsAdd ("overlaps read", 0x100000) ;
+    }
+  statsAdd ("overlaps read", nOverlaps & 0xfffff) ;
+  nChains = ofIn->info['a']->accum.count ;
+  printf ("%s: read %d overlaps in %d chains\n", in->fileName, (int) nOverlaps, nChains) ;
+  oneFileClose (ofIn) ; in->of = 0 ;
+
+  if (!in->db2Name) // add the reverse matches
+    { resize (olaps, nOverlaps, 2*nOverlaps, Overlap) ;
+      Overlap *o1 = olaps, *o2 = olaps + nOverlaps ;
+      for (i = 0 ; i < nOverlaps ; ++i, ++o1, ++o2)
+	{ flip (o1, o2) ;
+	  chain[i+nOverlaps] = chain[i] ? chain[i] + nChains : 0 ;
+	}
+      nOverlaps *= 2 ;
+      printf ("%s: self-alignment: doubled overlaps to %d\n", in->fileName, (int) nOverlaps) ;
+    }
+
+  // one pass finds all classes: for self-alignments the reverse matches give those in b
+  if (nChains && !isSweep)
+    { nPairs = variantFindChains (olaps, chain, nOverlaps, in->insA, in->insB) ;
+      printf ("%s: tested consecutive alignments in chains\n", in->fileName) ;
+    }
+  else
+    { overlapSort (olaps, nOverlaps) ;
+      if (isSweep)
+	{ nPairs = variantFind (olaps, nOverlaps, in->insA, in->insB) ;
+	  printf ("%s: tested all pairs of alignments up to %d apart\n", in->fileName, MAX_SIZE) ;
+	}
+      else
+	{ nPairs = variantFindDP (olaps, nOverlaps, in->insA, in->insB) ;
+	  printf ("%s: built chains and tested consecutive alignments\n", in->fileName) ;
+	}
+    }
+  free (olaps) ; free (chain) ;
+  statsAdd ("pairs tested", nPairs) ;
+
+  Array a = in->insA ;
+  if (a) for (i = 0 ; i < arrayMax(a) ; ++i) arrp(a,i,Insertion)->sample = in->sample ;
+  if ((a = in->insB)) for (i = 0 ; i < arrayMax(a) ; ++i) arrp(a,i,Insertion)->sample = in->sample ;
+}
+
+static void *inputThread (void *arg)
+{
+  InputPool *pool = (InputPool*) arg ;
+  int k ;
+  while ((k = __atomic_fetch_add (&pool->next, 1, __ATOMIC_RELAXED)) < nInputs)
+    inputProcess (pool->in + k) ;
+  return 0 ;
+}
+
+static char *sourceResolve (char *name, char *cpath)
+// cpath/name if there is such a file, else name as given, like alnSeqOpen() but cpath first
+// so that the same name from .1aln files in different directories gives different sources
+{
+  if (!name) return 0 ;
+  if (*name != '/' && *cpath)
+    { char *path = new (strlen(cpath) + strlen(name) + 2, char) ;
+      sprintf (path, "%s/%s", cpath, name) ;
+      if (!access (path, F_OK)) return path ;
+      free (path) ;
+    }
+  return strdup (name) ;
+}
+
+static inline char *sourceName (Input *in, bool isB) { return isB ? in->source2 : in->source1 ; }
+
+static bool isOneSource (Input *in, bool isB) // all inputs have the same source on this side
+{
+  int k ;
+  for (k = 0 ; k < nInputs ; ++k)
+    if (!sourceName (in+k, isB) || strcmp (sourceName (in+k, isB), sourceName (in, isB)))
+      return false ;
+  return true ;
+}
+
+static void headerWrite (OneFile *of, Input *in, bool isB)
+// With one input, its source names and cpath as in the .1aln.  With several, the resolved
+// source for each side if they all share it: seqids could not be resolved from several
+// references with the same index, so each sample's sources also follow its f line.
+{
+  int k ;
+  if (nInputs == 1)
+    { oneAddReference (of, isB ? in->db2Name : in->db1Name, 1) ;
+      if (!isB && in->db2Name) oneAddReference (of, in->db2Name, 2) ;
+      if (isB) oneAddReference (of, in->db1Name, 2) ;
+      oneAddReference (of, in->cpath, 3) ;
+    }
+  else
+    { if (isOneSource (in, isB)) oneAddReference (of, sourceName (in, isB), 1) ;
+      if (isOneSource (in, !isB)) oneAddReference (of, sourceName (in, !isB), 2) ;
+    }
+
+  oneInt(of,0) = MAX_OVERHANG ; oneWriteLine (of, 'o', 0, 0) ;
+  oneInt(of,0) = MAX_SIZE ; oneWriteLine (of, 'i', 0, 0) ;
+  oneInt(of,0) = MERGE_TOL ; oneWriteLine (of, 't', 0, 0) ;
+  if (nInputs > 1)
+    for (k = 0 ; k < nInputs ; ++k)
+      { char *a = sourceName (in+k, isB), *b = sourceName (in+k, !isB) ;
+	oneWriteLine (of, 'f', strlen(in[k].fileName), in[k].fileName) ;
+	oneWriteLine (of, 'x', strlen(a), a) ;
+	if (b) oneWriteLine (of, 'y', strlen(b), b) ;
+      }
+}
+
+static void reportBySource (OneFile *of, Input *in, bool isB)
+// report the variants of all inputs with the same source together, so each genome is read once
+{
+  bool *isDone = new0 (nInputs, bool) ;
+  int   k, j ;
+  for (k = 0 ; k < nInputs ; ++k)
+    if (!isDone[k])
+      { char  *name = sourceName (in+k, isB) ;
+	AlnSeq *as = isNoSeq ? 0 : alnSeqOpen (name, in[k].cpath, false) ;
+	if (!as && !isNoSeq) die ("failed to open %s", name) ;
+	Array  a = arrayCreate (4096, Insertion) ;
+	for (j = k ; j < nInputs ; ++j)
+	  if (!isDone[j] && !strcmp (sourceName (in+j, isB), name))
+	    { Array b = isB ? in[j].insB : in[j].insA ;
+	      U64   n = arrayMax(a) ;
+	      if (arrayMax(b)) // extend a by all of b
+		{ uArray (a, n + arrayMax(b) - 1) ;
+		  memcpy (arrp(a,n,Insertion), arrp(b,0,Insertion), arrayMax(b)*sizeof(Insertion)) ;
+		}
+	      isDone[j] = true ;
+	    }
+	insertionReport (of, as, a) ;
+	if (as) alnSeqClose (as) ;
+	arrayDestroy (a) ;
+      }
+  free (isDone) ;
+}
 
 int main (int argc, char *argv[])
 {
@@ -82,10 +335,12 @@ int main (int argc, char *argv[])
   OneSchema *schema = oneSchemaCreateFromText (schemaText) ;
   OneFile   *ofa = 0, *ofb = 0 ;
   char      *ofaName, *ofbName ;
+  FILE      *statsFile = 0 ;
+  int        progress = 0 ;
 
   if (!argc) usage () ;
   
-  while (argc > 1)
+  while (argc && **argv == '-')
     if (!strcmp (*argv, "-w") && argc > 2)
       { if ((MAX_OVERHANG = atoi(argv[1])) <= 0)
 	  die ("max_overhang %s must be a positive integer", argv[1]) ;
@@ -96,6 +351,34 @@ int main (int argc, char *argv[])
 	  die ("max_size %s must be a positive integer", argv[1]) ;
 	argc -= 2 ; argv += 2 ;
       }
+    else if (!strcmp (*argv, "-T") && argc > 2)
+      { if ((NTHREADS = atoi(argv[1])) <= 0)
+	  die ("number of threads %s must be a positive integer", argv[1]) ;
+	argc -= 2 ; argv += 2 ;
+      }
+    else if (!strcmp (*argv, "-t") && argc > 2)
+      { if ((MERGE_TOL = atoi(argv[1])) < 0)
+	  die ("merge tolerance %s must be a non-negative integer", argv[1]) ;
+	argc -= 2 ; argv += 2 ;
+      }
+    else if (!strcmp (*argv, "-p") && argc > 2)
+      { if ((progress = atoi(argv[1])) <= 0)
+	  die ("progress interval %s must be a positive integer", argv[1]) ;
+	argc -= 2 ; argv += 2 ;
+      }
+    else if (!strcmp (*argv, "-j") && argc > 2)
+      { if (!(statsFile = fopen (argv[1], "w")))
+	  die ("failed to open stats file %s to write", argv[1]) ;
+	argc -= 2 ; argv += 2 ;
+      }
+    else if (!strcmp (*argv, "-s"))
+      { isSweep = true ;
+	--argc ; ++argv ;
+      }
+    else if (!strcmp (*argv, "-n"))
+      { isNoSeq = true ;
+	--argc ; ++argv ;
+      }
     else if (!strcmp (*argv, "-a") && argc > 2)
       { if (!(ofa = oneFileOpenWriteNew (argv[1], schema, "sv", true, 1)))
 	  die ("failed to open .1insert file %s to write", argv[1]) ;
@@ -115,137 +398,611 @@ int main (int argc, char *argv[])
 	usage () ;
       }
 
-  I64      nOverlaps ;
-  char    *db1Name = 0, *db2Name = 0, *cpath = 0 ;
-  OneFile *ofIn = alnOpenRead (*argv, 1, &nOverlaps, 0, &db1Name, &db2Name, &cpath) ;
-    
-  if (!ofIn) die ("failed to open .1aln file %s", *argv) ;
-
-  AlnSeq *as = 0, *bs = 0 ;
-  
-  if (ofa)
-    { oneAddReference (ofa, db1Name, 1) ;
-      if (db2Name) oneAddReference (ofa, db2Name, 2) ;
-      if (cpath) oneAddReference (ofa, cpath, 3) ;
-      if (!(as = alnSeqOpen (db1Name, cpath, false))) die ("failed to open %s", db1Name) ;
+  if (!argc) usage () ;
+  if (progress || statsFile)
+    { statsStart (stderr, progress) ;
+      oneCloseHook = oneStats ;
+      statsPhase ("open") ;
     }
-
-  if (ofb)
-    { if (!db2Name)
-	die ("-b not possible: input %s has no b source (it has self-a alignments only)", *argv) ;
-      oneAddReference (ofb, db2Name, 1) ; // NB change of order here
-      oneAddReference (ofb, db1Name, 2) ;
-      oneAddReference (ofb, cpath, 3) ;
-      if (!(bs = alnSeqOpen (db2Name, cpath, false))) die ("failed to open %s", db2Name) ;
+  nInputs = argc ;
+  Input *in = new0 (nInputs, Input) ;
+  int    k ;
+  for (k = 0 ; k < nInputs ; ++k) // serially, because ONElib schema parsing is not reentrant
+    { in[k].fileName = argv[k] ; in[k].sample = k ;
+      if (!(in[k].of = alnOpenRead (argv[k], 1, &in[k].nOverlaps, 0,
+				    &in[k].db1Name, &in[k].db2Name, &in[k].cpath)))
+	die ("failed to open .1aln file %s", argv[k]) ;
+      if (ofb && !in[k].db2Name)
+	die ("-b not possible: input %s has no b source (it has self-a alignments only)", argv[k]) ;
+      in[k].source1 = sourceResolve (in[k].db1Name, in[k].cpath) ;
+      in[k].source2 = sourceResolve (in[k].db2Name, in[k].cpath) ;
+      in[k].insA = ofa ? arrayCreate (4096, Insertion) : 0 ;
+      in[k].insB = ofb ? arrayCreate (4096, Insertion) : 0 ;
     }
 
-  Overlap *olaps = new (nOverlaps, Overlap) ;
-  int i ;
-  for (i = 0 ; i < nOverlaps ; ++i)
-    { alnReadOverlap (ofIn, olaps+i) ;
-      alnSkipTrace (ofIn) ;
-    }
-  printf ("read %d overlaps\n", (int) nOverlaps) ;
-  oneFileClose (ofIn) ;
+  if (ofa) headerWrite (ofa, in, false) ;
+  if (ofb) headerWrite (ofb, in, true) ; // NB change of order here
 
-  if (!db2Name) // add the reverse matches
-    { resize (olaps, nOverlaps, 2*nOverlaps, Overlap) ;
-      Overlap *o1 = olaps, *o2 = olaps + nOverlaps ;
-      for (i = 0 ; i < nOverlaps ; ++i, ++o1, ++o2) flip (o1, o2) ;
-      nOverlaps *= 2 ;
-      printf ("self-alignment: doubled overlaps to %d\n", (int) nOverlaps) ;
-    }
+  // each input is independent up to reporting, so share them out over a pool of threads
+  statsPhase ("find") ;
+  int        t, nThreads = (NTHREADS < nInputs) ? NTHREADS : nInputs ;
+  pthread_t *threads = new (nThreads, pthread_t) ;
+  InputPool  pool = { in, 0 } ;
+  for (t = 1 ; t < nThreads ; ++t) pthread_create (&threads[t], 0, inputThread, &pool) ;
+  inputThread (&pool) ;		// this thread does its share
+  for (t = 1 ; t < nThreads ; ++t) pthread_join (threads[t], 0) ;
+  free (threads) ;
   timeUpdate (stdout) ;
 
   if (ofa)
-    { qsort (olaps, nOverlaps, sizeof(Overlap), overlapOrder) ;
-      insertionReport (ofa, as, olaps, nOverlaps) ;
-      printf ("wrote %d insertions in %s to %s\n",
-	      (int)ofa->info['V']->accum.count, db1Name, ofaName) ;
+    { reportBySource (ofa, in, false) ;
+      printf ("wrote %d insertions, %d duplications in a to %s\n",
+	      (int)ofa->info['V']->accum.count, (int)ofa->info['U']->accum.count, ofaName) ;
       oneFileClose (ofa) ;
       timeUpdate (stdout) ;
     }
 
   if (ofb)
-    { Overlap *o1 = olaps ;
-      for (i = 0 ; i < nOverlaps ; ++i, ++o1) flip (o1, o1) ;
-      qsort (olaps, nOverlaps, sizeof(Overlap), overlapOrder) ;
-      insertionReport (ofb, bs, olaps, nOverlaps) ;
-      printf ("wrote %d insertions in %s to %s\n",
-	      (int)ofb->info['V']->accum.count, db2Name, ofbName) ;
+    { reportBySource (ofb, in, true) ;
+      printf ("wrote %d insertions, %d duplications in b to %s\n",
+	      (int)ofb->info['V']->accum.count, (int)ofb->info['U']->accum.count, ofbName) ;
       oneFileClose (ofb) ;
       timeUpdate (stdout) ;
     }
 
+  for (k = 0 ; k < nInputs ; ++k)
+    { free (in[k].db1Name) ; free (in[k].db2Name) ;
+      free (in[k].source1) ; if (in[k].source2) free (in[k].source2) ;
+      if (in[k].insA) arrayDestroy (in[k].insA) ;
+      if (in[k].insB) arrayDestroy (in[k].insB) ;
+    }
+  free (in) ;
+
+  if (statsFile) { statsReport (statsFile) ; fclose (statsFile) ; }
+
   printf ("Total resources used: ") ; timeTotal (stdout) ;
 }
 
+/***************** annotation of TSDs, TIRs and LTRs *****************/
+
+static SeqPack *seqPacker ;
+
+static inline U32 packedBase (U8 *u, U64 i) { return (u[i >> 2] >> 2*(i & 3)) & 3 ; }
+
+static inline U32 packedSeed (U8 *u, U64 i) // SEED-mer at i, as rolled up in insertionAnnotate()
+{ U32 w = 0 ; U64 j ;
+  for (j = i ; j < i + SEED ; ++j) w = (w << 2) | packedBase (u, j) ;
+  return w ;
+}
+
+static inline void ltrTry (Insertion *ins, U8 *u, int d1, U64 m, U64 d)
+// element of length m at u[d1..], candidate repeat copies at offsets 0 and d in it
+{ U64 len = m - d, nMis ;
+  if (d < m && len >= MIN_LTR && len > ins->ltrLen && len <= d &&
+      (nMis = seqHammingPacked (u, d1, u, d1 + d, len)) * 100 <= len * MAX_LTR_DIFF)
+    { ins->ltrLen = len ; ins->ltrMis = nMis ; }
+}
+
+static void insertionAnnotate (Insertion *ins, char *x, U8 **u, U8 **rc, U64 *uSize)
+// TSD: the longest exact direct repeat spanning the pair of breakpoints, starting from the
+//   b-overlap of the flanking alignments; the inserted element lies between its two copies
+// TIR: X-drop extension of the element against its reverse complement, from the two ends
+// LTR: exact SEED-mer near either end of the element found in its other half, then Hamming
+// The element ends are uncertain by a few bases, since repeats can extend by chance, so
+// the TIR and LTR searches allow SLOP bases either way
+// x[i] is a[i] for lo <= i < hi
+{
+  int   k = ins->b_match_begin - ins->b_match_end ; // target site from the b overlap
+  int   s1 = ins->a_begin - (k > 0 ? k : 0), s2 = ins->a_end ;
+  int   left = 0, right = 0 ;
+
+  // compare ignoring case, since a soft-masked element can carry one copy of its TSD
+  while (s1-left > ins->lo && s1+right+1 < s2-left && left+right <= MAX_TSD &&
+	 (x[s1-left-1] | 0x20) == (x[s2-left-1] | 0x20)) ++left ;
+  while (s2+right < ins->hi && s1+right+1 < s2-left && left+right <= MAX_TSD &&
+	 (x[s1+right] | 0x20) == (x[s2+right] | 0x20)) ++right ;
+  if (left+right >= MIN_TSD && left+right <= MAX_TSD)
+    { ins->tsdBegin = s1 - left ; ins->tsdLen = left + right ;
+      s1 += right ; s2 -= left ;	// the element is now a[s1,s2)
+    }
+  else
+    { s1 = ins->a_begin ; s2 = ins->a_end ; }
+
+  if (s2 - s1 < 2*MIN_TIR) return ;
+  int   b1 = (s1 - SLOP > ins->lo) ? s1 - SLOP : ins->lo ;
+  int   b2 = (s2 + SLOP < ins->hi) ? s2 + SLOP : ins->hi ;
+  int   d1 = s1 - b1, d2 = b2 - s2, i, j ;
+  char *e = x + b1 ;		// pack a[b1,b2) and its reverse complement
+  U64   n = b2 - b1, len, nMis, d ;
+  if ((n+3)/4 > *uSize)
+    { *uSize = (n+3)/4 + 4096 ;
+      free (*u) ; *u = new (*uSize, U8) ;
+      free (*rc) ; *rc = new (*uSize, U8) ;
+    }
+  seqPack (seqPacker, e, *u, n) ;
+  seqRevCompPacked (*u, *rc, n) ;
+
+  for (i = 0 ; i <= d1 + SLOP ; ++i)	// element a[b1+i,b2-j)
+    for (j = 0 ; j <= d2 + SLOP ; ++j)
+      { len = seqExtendPacked (*u, i, *rc, j, (n-i-j)/2, X_DROP, &nMis) ;
+	if (len >= MIN_TIR && len > ins->tirLen) { ins->tirLen = len ; ins->tirMis = nMis ; }
+      }
+
+  if (s2 - s1 < 2*MIN_LTR) return ;
+  U32 seed5[NSEED], seed3[NSEED], w = 0 ; // NSEED seeds at each end, in case one has a mismatch
+  U64 off5[NSEED], off3[NSEED] ;
+  for (i = 0 ; i < NSEED ; ++i)
+    { off5[i] = d1 + SLOP + i*SEED ; seed5[i] = packedSeed (*u, off5[i]) ;
+      off3[i] = n - d2 - SLOP - (i+1)*SEED ; seed3[i] = packedSeed (*u, off3[i]) ;
+    }
+  for (d = n/2 ; d < n ; ++d) // roll SEED-mers through the 3' half, looking for 5' seeds
+    { w = (w << 2) | packedBase (*u, d) ;
+      if (d + 1 >= n/2 + SEED)
+	for (i = 0 ; i < NSEED ; ++i)
+	  if (w == seed5[i]) ltrTry (ins, *u, d1, s2 - s1, d + 1 - SEED - off5[i]) ;
+    }
+  for (d = 0 ; d < n/2 ; ++d) // and through the 5' half, looking for 3' seeds
+    { w = (w << 2) | packedBase (*u, d) ;
+      if (d + 1 >= SEED)
+	for (i = 0 ; i < NSEED ; ++i)
+	  if (w == seed3[i]) ltrTry (ins, *u, d1, s2 - s1, off3[i] - (d + 1 - SEED)) ;
+    }
+}
+
 typedef struct {
-  int a, a_begin, a_end ;
-  int b, b_match_begin, b_match_end ;
-} Insertion ;
+  Insertion      *ins ;
+  U64             n ;
+  char           *pool ;
+  U64             poolSize ;
+  U64             nReady ;	// ins[0,nReady) have their sequence in the pool
+  U64             next ;	// next insertion to annotate
+  bool           *isDone ;	// isDone[i] once ins[i] is annotated, so can be written
+  pthread_mutex_t lock ;
+  pthread_cond_t  cond ;	// signalled when nReady grows or insertions are done
+} Annotator ;
+
+#define ANNOTATE_BATCH 64
+#define POOL_SIZE (1 << 26)	// flank pool ring size, unless one insertion needs more
+
+static inline char *annotatorSeq (Annotator *an, Insertion *ins) // x[i] is a[i], lo <= i < hi
+{ return an->pool + ins->pool % an->poolSize - ins->lo ; }
 
-static int insertionOrder (const void *x, const void *y) // need complete sort because will compress
-{
-  Insertion *ix = (Insertion*)x, *iy = (Insertion*)y ;
-  int c = ix->a - iy->a ; if (c) return c ;
-  c = ix->a_begin - iy->a_begin ; if (c) return c ;
-  c = ix->a_end - iy->a_end ; return c ;
-}
-
-void insertionReport (OneFile *of, AlnSeq *as, Overlap *olap, int n)
-// look for insertions in a with respect to b, so olap is sorted on b, then a, then b_begin
-// need to accumulate in an array and deduplicate
-{
-  int i,j ;
-  Overlap *oi, *oj ;
-  Array a = arrayCreate (4096, Insertion) ;
-
-  for (i = 0, oi = olap ; i < n ; ++i, ++oi)
-    for (j = i+1, oj = oi + 1 ; j < n ; ++j, ++oj)
-      if (oj->aread != oi->aread || oj->bread != oi->bread) break ;
-      else if (COMP(oj->flags) != COMP(oi->flags)) continue ;
-      else if (oj->path.bbpos < oi->path.bepos - MAX_OVERHANG) continue ;
-      else if (oj->path.bbpos > oi->path.bepos + MAX_OVERHANG) break ;
-      else if (COMP(oj->flags) &&
-	       oi->path.abpos > oj->path.aepos &&
-	       oi->path.abpos < oj->path.aepos + MAX_SIZE)
-	{ Insertion *ins = arrayp (a, arrayMax(a), Insertion) ;
-	  ins->a = oj->aread ; ins->a_begin = oj->path.aepos ; ins->a_end = oi->path.abpos ;
-	  ins->b = oj->bread ; ins->b_match_begin = oi->path.bepos ; ins->b_match_end = oj->path.bbpos ;
+static void *annotateThread (void *arg)
+// take batches of insertions as their sequence becomes available, until all are taken
+{
+  Annotator *an = (Annotator*) arg ;
+  U8  *u = 0, *rc = 0 ;
+  U64  uSize = 0, i, i0, i1 ;
+  while (true)
+    { pthread_mutex_lock (&an->lock) ;
+      while (an->next < an->n && an->next == an->nReady) pthread_cond_wait (&an->cond, &an->lock) ;
+      i0 = an->next ;
+      i1 = (an->nReady - i0 < ANNOTATE_BATCH) ? an->nReady : i0 + ANNOTATE_BATCH ;
+      an->next = i1 ;
+      pthread_mutex_unlock (&an->lock) ;
+      if (i0 == i1) break ;	// nothing left
+      for (i = i0 ; i < i1 ; ++i)
+	if (!an->ins[i].isDup)
+	  insertionAnnotate (an->ins + i, annotatorSeq (an, an->ins + i), &u, &rc, &uSize) ;
+      pthread_mutex_lock (&an->lock) ;
+      for (i = i0 ; i < i1 ; ++i) an->isDone[i] = true ;
+      pthread_cond_broadcast (&an->cond) ;
+      pthread_mutex_unlock (&an->lock) ;
+    }
+  free (u) ; free (rc) ;
+  return 0 ;
+}
+
+static inline void annotatorReady (Annotator *an, U64 nReady)
+{
+  pthread_mutex_lock (&an->lock) ;
+  an->nReady = nReady ;
+  pthread_cond_broadcast (&an->cond) ;
+  pthread_mutex_unlock (&an->lock) ;
+}
+
+static inline U64 annotatorWait (Annotator *an, U64 i) // wait for ins[i], return end of done run
+{
+  pthread_mutex_lock (&an->lock) ;
+  while (!an->isDone[i]) pthread_cond_wait (&an->cond, &an->lock) ;
+  while (i < an->n && an->isDone[i]) ++i ;
+  pthread_mutex_unlock (&an->lock) ;
+  return i ;
+}
+
+/********************* finding and reporting variants *********************/
+
+static inline void variantAdd (Array a, bool isDup, int x, int xBegin, int xEnd,
+			       int y, int yBegin, int yEnd)
+{
+  if (!a) return ;
+  Insertion *ins = arrayPush (a, Insertion) ;
+  bzero (ins, sizeof(Insertion)) ;
+  ins->isDup = isDup ; ins->nSupport = 1 ;
+  ins->a = x ; ins->a_begin = xBegin ; ins->a_end = xEnd ;
+  ins->b = y ; ins->b_match_begin = yBegin ; ins->b_match_end = yEnd ;
+}
+
+static void variantPair (Overlap *oi, Overlap *oj, Array insA, Array insB)
+// oj follows oi in b: classify the pair by its gaps ga in a and gb in b, up to MAX_OVERHANG = w:
+//   |gb| <= w, ga > 0  : insertion in a		|ga| <= w, gb > 0  : insertion in b
+//   |ga| <= w, gb < -w : duplication in a	|gb| <= w, ga < -w : duplication in b
+// For an insertion b_match_begin,end are the end and start of the flanking matches in the
+// other sequence, and for a duplication they give the single copy.  The extra copy is the
+// second on its own axis, taken from the start of oj, or of oi for a reverse duplication in
+// a since oi is then later in a, so that alignment must be at least that long there.
+{
+  int ga, gb = oj->path.bbpos - oi->path.bepos, w = MAX_OVERHANG ;
+
+  if (gb <= -MAX_SIZE || gb >= MAX_SIZE) return ;
+  if (COMP(oj->flags)) // a runs backwards: oj is before oi in a
+    { ga = oi->path.abpos - oj->path.aepos ;
+      if (ga > 0 && ga < MAX_SIZE && gb >= -w && gb <= w)
+	variantAdd (insA, false, oj->aread, oj->path.aepos, oi->path.abpos,
+		    oj->bread, oi->path.bepos, oj->path.bbpos) ;
+      if (gb > 0 && ga >= -w && ga <= w)
+	variantAdd (insB, false, oj->bread, oi->path.bepos, oj->path.bbpos,
+		    oj->aread, oj->path.aepos, oi->path.abpos) ;
+      else if (gb < -w && ga >= -w && ga <= w && -gb <= oi->path.aepos - oi->path.abpos)
+	variantAdd (insA, true, oj->aread, oi->path.abpos, oi->path.abpos - gb,
+		    oj->bread, oj->path.bbpos, oi->path.bepos) ;
+      else if (ga < -w && ga > -MAX_SIZE && gb >= -w && gb <= w && -ga <= oj->path.bepos - oj->path.bbpos)
+	variantAdd (insB, true, oj->bread, oj->path.bbpos, oj->path.bbpos - ga,
+		    oj->aread, oi->path.abpos, oj->path.aepos) ;
+    }
+  else
+    { ga = oj->path.abpos - oi->path.aepos ;
+      if (ga > 0 && ga < MAX_SIZE && gb >= -w && gb <= w)
+	variantAdd (insA, false, oj->aread, oi->path.aepos, oj->path.abpos,
+		    oj->bread, oi->path.bepos, oj->path.bbpos) ;
+      if (gb > 0 && ga >= -w && ga <= w)
+	variantAdd (insB, false, oj->bread, oi->path.bepos, oj->path.bbpos,
+		    oj->aread, oi->path.aepos, oj->path.abpos) ;
+      else if (gb < -w && ga >= -w && ga <= w && -gb <= oj->path.aepos - oj->path.abpos)
+	variantAdd (insA, true, oj->aread, oj->path.abpos, oj->path.abpos - gb,
+		    oj->bread, oj->path.bbpos, oi->path.bepos) ;
+      else if (ga < -w && ga > -MAX_SIZE && gb >= -w && gb <= w && -ga <= oj->path.bepos - oj->path.bbpos)
+	variantAdd (insB, true, oj->bread, oj->path.bbpos, oj->path.bbpos - ga,
+		    oj->aread, oj->path.abpos, oi->path.aepos) ;
+    }
+}
+
+typedef struct { int end, i ; } ChainEnd ;
+#define CHAINEND_LT(x,y) ((x)->end < (y)->end)
+ARRAY_SORT_DEFINE(chainEnd, ChainEnd, CHAINEND_LT)
+
+static inline int chainEndLower (ChainEnd *e, int m, int x) // first k with e[k].end >= x
+{
+  int k, l = 0, r = m ;
+  while (l < r)
+    { k = (l + r) / 2 ;
+      if (e[k].end < x) l = k+1 ; else r = k ;
+    }
+  return r ;
+}
+
+I64 variantFind (Overlap *olap, int n, Array insA, Array insB)
+// exhaustive: olap is sorted on b, then a, then b_begin.  variantPair() only reports a pair whose
+// gap in b or in a is within MAX_OVERHANG = w, so for each oi test every later oj in its (a,b)
+// block with the same orientation that starts within w of the end of oi in b, found by binary
+// search on b_begin, or within w of it in a, found in a view of the block sorted on the a end
+// that oj continues from: a_begin if forward, a_end if reverse
+{
+  ChainEnd *e = new (n, ChainEnd) ;
+  int       i, j, i0, i1, k, l, r, w = MAX_OVERHANG ;
+  I64       nPairs = 0 ;
+  Overlap  *oi, *oj ;
+
+  for (i0 = 0 ; i0 < n ; i0 = i1)
+    { for (i1 = i0+1 ; i1 < n && olap[i1].aread == olap[i0].aread &&
+	     olap[i1].bread == olap[i0].bread ; ++i1) { ; }
+      int m = 0, mf ;		// e[0,mf) forward a_begins, e[mf,m) reverse a_ends, each sorted
+      for (i = i0, oi = olap + i0 ; i < i1 ; ++i, ++oi)
+	if (!COMP(oi->flags)) { e[m].end = oi->path.abpos ; e[m++].i = i ; }
+      mf = m ;
+      for (i = i0, oi = olap + i0 ; i < i1 ; ++i, ++oi)
+	if (COMP(oi->flags)) { e[m].end = oi->path.aepos ; e[m++].i = i ; }
+      chainEndSort (e, mf) ;
+      chainEndSort (e + mf, m - mf) ;
+
+      for (i = i0, oi = olap + i0 ; i < i1 ; ++i, ++oi)
+	{ int bLo = oi->path.bepos - w, bHi = oi->path.bepos + w ;
+	  for (l = i+1, r = i1 ; l < r ; ) // first oj after oi with b_begin >= bLo
+	    { k = (l + r) / 2 ;
+	      if (olap[k].path.bbpos < bLo) l = k+1 ; else r = k ;
+	    }
+	  for (j = r, oj = olap + r ; j < i1 && oj->path.bbpos <= bHi ; ++j, ++oj)
+	    if (COMP(oj->flags) == COMP(oi->flags)) { variantPair (oi, oj, insA, insB) ; ++nPairs ; }
+
+	  ChainEnd *ea = COMP(oi->flags) ? e + mf : e ;
+	  int       ma = COMP(oi->flags) ? m - mf : mf ;
+	  int       a = COMP(oi->flags) ? oi->path.abpos : oi->path.aepos ;
+	  for (k = chainEndLower (ea, ma, a - w) ; k < ma && ea[k].end <= a + w ; ++k)
+	    if ((j = ea[k].i) > i)
+	      { oj = olap + j ;
+		if (oj->path.bbpos < bLo || oj->path.bbpos > bHi) // else tested above
+		  { variantPair (oi, oj, insA, insB) ; ++nPairs ; }
+	      }
 	}
-      else if (!COMP(oj->flags) &&
-	       oj->path.abpos > oi->path.aepos &&
-	       oj->path.abpos < oi->path.aepos + MAX_SIZE)
-	{ Insertion *ins = arrayp (a, arrayMax(a), Insertion) ;
-	  ins->a = oj->aread ; ins->a_begin = oi->path.aepos ; ins->a_end = oj->path.abpos ;
-	  ins->b = oj->bread ; ins->b_match_begin = oi->path.bepos ; ins->b_match_end = oj->path.bbpos ;
+    }
+
+  free (e) ;
+  return nPairs ;
+}
+
+static inline bool chainPair (Overlap *o1, Overlap *o2, Array insA, Array insB)
+{
+  if (o1->aread != o2->aread || o1->bread != o2->bread || COMP(o1->flags) != COMP(o2->flags))
+    return false ;
+  if (o1->path.bbpos <= o2->path.bbpos) variantPair (o1, o2, insA, insB) ;
+  else variantPair (o2, o1, insA, insB) ;
+  return true ;
+}
+
+I64 variantFindChains (Overlap *olap, int *chain, int n, Array insA, Array insB)
+// olap is in file order, and chain[i] > 0 is the .1aln chain ('a' object) containing olap[i],
+// so only test consecutive members of each chain
+{
+  int i ;
+  I64 nPairs = 0 ;
+  for (i = 1 ; i < n ; ++i)
+    if (chain[i] && chain[i] == chain[i-1] && chainPair (olap+i-1, olap+i, insA, insB)) ++nPairs ;
+  return nPairs ;
+}
+
+#define NO_CHAIN  ((I64)1 << 62)
+
+static inline I64 chainScore (Overlap *oj, Overlap *oi, I64 fj)
+// score for oi following oj, which has chain score fj, or -NO_CHAIN if it can not
+{
+  if (COMP(oj->flags) != COMP(oi->flags) || oj->path.bbpos >= oi->path.bbpos) return -NO_CHAIN ;
+  int gb = oi->path.bbpos - oj->path.bepos, ga ;
+  if (COMP(oi->flags))
+    { if (oi->path.abpos >= oj->path.abpos) return -NO_CHAIN ;
+      ga = oj->path.abpos - oi->path.aepos ;
+    }
+  else
+    { if (oi->path.abpos <= oj->path.abpos) return -NO_CHAIN ;
+      ga = oi->path.abpos - oj->path.aepos ;
+    }
+  if (gb <= -MAX_SIZE || gb >= MAX_SIZE || ga <= -MAX_SIZE || ga >= MAX_SIZE) return -NO_CHAIN ;
+  I64 d = (ga > gb) ? ga - gb : gb - ga ; // indel size
+  I64 g = (ga < gb) ? ga : gb ;		  // unaligned in both if positive, else overlap
+  return fj + (oi->path.aepos - oi->path.abpos) - d / CHAIN_GAP_DIV - (g < 0 ? -g : g) ;
+}
+
+I64 variantFindDP (Overlap *olap, int n, Array insA, Array insB)
+// for files without chains: sparse DP chaining, as in minimap2, within each (a,b) block of olap
+// sorted on b, a, b_begin.  Each overlap oi considers as predecessors the CHAIN_LOOKBACK earlier
+// ones whose b ends are nearest its b start, plus the highest scoring one ending within MAX_SIZE
+// of it, found with a max segment tree over the b ends.  It scores its length plus the best
+// predecessor score less a gap cost, and is then tested against its best predecessor only.
+{
+  I64      *f = new (n, I64) ;
+  int      *pred = new (n, int) ;
+  ChainEnd *e = new (n, ChainEnd) ;
+  int      *pos = new (n, int) ;	// position of olap[i0+x] in e
+  int      *tree = new (4*n+2, int) ;	// max segment tree over e: index into olap, or -1
+  int       i, j, i0, i1, k, l, r, t, sz ;
+  I64       score, nPairs = 0 ;
+  Overlap  *oi ;
+
+  for (i0 = 0 ; i0 < n ; i0 = i1)
+    { for (i1 = i0+1 ; i1 < n && olap[i1].aread == olap[i0].aread &&
+	     olap[i1].bread == olap[i0].bread ; ++i1) { ; }
+      int m = i1 - i0 ;		// block is olap[i0,i1), e[0,m) its b ends in sorted order
+      for (i = i0 ; i < i1 ; ++i) { e[i-i0].end = olap[i].path.bepos ; e[i-i0].i = i ; }
+      chainEndSort (e, m) ;
+      for (k = 0 ; k < m ; ++k) pos[e[k].i - i0] = k ;
+      for (sz = 1 ; sz < m ; sz <<= 1) { ; }
+      for (k = 0 ; k < 2*sz ; ++k) tree[k] = -1 ;
+
+      for (i = i0, oi = olap + i0 ; i < i1 ; ++i, ++oi)
+	{ f[i] = oi->path.aepos - oi->path.abpos ; pred[i] = -1 ;
+	  r = chainEndLower (e, m, oi->path.bbpos) ;
+	  for (l = r-1, t = 0 ; t < CHAIN_LOOKBACK && (l >= 0 || r < m) ; ++t)
+	    { if (r >= m || (l >= 0 && oi->path.bbpos - e[l].end <= e[r].end - oi->path.bbpos))
+		j = e[l--].i ;
+	      else
+		j = e[r++].i ;
+	      if (j < i && (score = chainScore (olap+j, oi, f[j])) > f[i])
+		{ f[i] = score ; pred[i] = j ; }
+	    }
+	  l = chainEndLower (e, m, oi->path.bbpos - MAX_SIZE) + sz ;	// tree query on [l,r)
+	  r = chainEndLower (e, m, oi->path.bbpos + MAX_SIZE) + sz ;
+	  for (j = -1 ; l < r ; l >>= 1, r >>= 1)
+	    { if (l & 1) { k = tree[l++] ; if (k >= 0 && (j < 0 || f[k] > f[j])) j = k ; }
+	      if (r & 1) { k = tree[--r] ; if (k >= 0 && (j < 0 || f[k] > f[j])) j = k ; }
+	    }
+	  if (j >= 0 && (score = chainScore (olap+j, oi, f[j])) > f[i])
+	    { f[i] = score ; pred[i] = j ; }
+	  if (pred[i] >= 0) { variantPair (olap + pred[i], oi, insA, insB) ; ++nPairs ; }
+	  for (k = pos[i-i0] + sz, tree[k] = i, k >>= 1 ; k ; k >>= 1) // add oi to the tree
+	    { l = tree[2*k] ; r = tree[2*k+1] ;
+	      tree[k] = (l < 0 || (r >= 0 && f[r] > f[l])) ? r : l ;
+	    }
 	}
+    }
 
-  arraySort (a, insertionOrder) ;
-  arrayCompress (a, insertionOrder) ;
+  free (f) ; free (pred) ; free (e) ; free (pos) ; free (tree) ;
+  return nPairs ;
+}
 
-  oneInt(of,0) = MAX_OVERHANG ; oneWriteLine (of, 'o', 0, 0) ;
-  oneInt(of,0) = MAX_SIZE ; oneWriteLine (of, 'i', 0, 0) ;
-  U64   ias = 0, sLen = 0 ;
+/********************* merging redundant calls *********************/
+
+typedef struct { Insertion *x ; U64 n ; } SortArg ;
+
+static void *sortThread (void *arg)
+{ SortArg *sa = (SortArg*) arg ; insertionSort (sa->x, sa->n) ; return 0 ; }
+
+static void insertionSortParallel (Insertion *x, U64 n)
+// sort NTHREADS chunks of x in parallel, then merge neighbouring runs until there is one
+{
+  int t, k, nRun = (n < 1024*NTHREADS) ? 1 : NTHREADS ;
+  if (nRun == 1) { insertionSort (x, n) ; return ; }
+
+  U64       *run = new (nRun+1, U64) ; // run t is [run[t],run[t+1])
+  pthread_t *threads = new (nRun, pthread_t) ;
+  SortArg   *args = new (nRun, SortArg) ;
+  for (t = 0 ; t <= nRun ; ++t) run[t] = (n * t) / nRun ;
+  for (t = 0 ; t < nRun ; ++t) { args[t].x = x + run[t] ; args[t].n = run[t+1] - run[t] ; }
+  for (t = 1 ; t < nRun ; ++t) pthread_create (&threads[t], 0, sortThread, &args[t]) ;
+  sortThread (&args[0]) ;
+  for (t = 1 ; t < nRun ; ++t) pthread_join (threads[t], 0) ;
+
+  Insertion *src = x, *dst = new (n, Insertion), *tmp ;
+  while (nRun > 1)
+    { for (t = 0, k = 0 ; t < nRun ; t += 2, ++k)
+	{ U64 i = run[t], iEnd = run[t+1], j = iEnd, d = i ;
+	  U64 jEnd = (t+1 < nRun) ? run[t+2] : iEnd ; // odd run out is just copied
+	  while (i < iEnd && j < jEnd)
+	    dst[d++] = INSERTION_LT(&src[j],&src[i]) ? src[j++] : src[i++] ;
+	  while (i < iEnd) dst[d++] = src[i++] ;
+	  while (j < jEnd) dst[d++] = src[j++] ;
+	  run[k] = run[t] ;
+	}
+      run[k] = n ; nRun = k ;
+      tmp = src ; src = dst ; dst = tmp ;
+    }
+  if (src != x) { memcpy (x, src, n*sizeof(Insertion)) ; dst = src ; }
+  free (dst) ; free (run) ; free (threads) ; free (args) ;
+}
+
+static inline bool isNear (int x, int y) { return x - y <= MERGE_TOL && y - x <= MERGE_TOL ; }
+
+static U64 insertionCluster (Insertion *x, U64 n)
+// x is sorted on a, a_begin, so sweep along each a keeping the clusters whose first member
+// starts within MERGE_TOL of the current call.  A call joins the first such cluster of the
+// same class, b and sample whose first member agrees with it within MERGE_TOL on a_end and
+// on both b matches, else starts a new cluster.  The first member represents the cluster,
+// with nSupport summed.  Clusters are written back to the front of x in order, so the active
+// ones are x[first,m), and x stays sorted on a, a_begin.  Returns the number of clusters m.
+{
+  U64 i, k, first = 0, m = 0 ;
+  for (i = 0 ; i < n ; ++i)
+    { Insertion *ins = x + i ;
+      while (first < m && (x[first].a != ins->a || x[first].a_begin < ins->a_begin - MERGE_TOL))
+	++first ;
+      for (k = first ; k < m ; ++k)
+	{ Insertion *c = x + k ;
+	  if (c->isDup == ins->isDup && c->sample == ins->sample && c->b == ins->b &&
+	      isNear (c->a_end, ins->a_end) && isNear (c->b_match_begin, ins->b_match_begin) &&
+	      isNear (c->b_match_end, ins->b_match_end))
+	    { c->nSupport += ins->nSupport ; break ; }
+	}
+      if (k == m) x[m++] = *ins ; // m <= i, so safe
+    }
+  return m ;
+}
+
+static void insertionWrite (OneFile *of, Insertion *ins, char *x)
+// x[i] is a[i] for lo <= i < hi, or 0 to write the record without sequences
+{
+  char idBuf[80] ;
+  oneInt(of,0) = ins->a ; oneInt(of,1) = ins->a_begin ; oneInt(of,2) = ins->a_end ;
+  oneWriteLine (of, ins->isDup ? 'U' : 'V', 0, 0) ;
+  oneInt(of,0) = ins->b ; oneInt(of,1) = ins->b_match_begin ; oneInt(of,2) = ins->b_match_end ;
+  oneWriteLine (of, ins->isDup ? 'C' : 'B', 0, 0) ;
+  oneInt(of,0) = ins->nSupport ; oneWriteLine (of, 'N', 0, 0) ;
+  if (nInputs > 1) { oneInt(of,0) = ins->sample ; oneWriteLine (of, 'F', 0, 0) ; }
+  if (!x) return ;
+  if (ins->tsdLen) oneWriteLine (of, 'D', ins->tsdLen, x + ins->tsdBegin) ;
+  if (ins->tirLen)
+    { oneInt(of,0) = ins->tirLen ; oneInt(of,1) = ins->tirMis ; oneWriteLine (of, 'R', 0, 0) ; }
+  if (ins->ltrLen)
+    { oneInt(of,0) = ins->ltrLen ; oneInt(of,1) = ins->ltrMis ; oneWriteLine (of, 'T', 0, 0) ; }
+  oneWriteLine (of, 'S', ins->a_end - ins->a_begin, x + ins->a_begin) ;
+  int n = sprintf (idBuf, "%d:%d-%d_%d:%d-%d",
+		   ins->a, ins->a_begin, ins->a_end, ins->b, ins->b_match_begin, ins->b_match_end) ;
+  oneWriteLine (of, 'I', n, idBuf) ;
+}
+
+static void annotatedWrite (OneFile *of, Annotator *an, U64 i, U64 *nWritable, int *nAnn)
+// write ins[i] once it is annotated, counting TSDs, TIRs and LTRs in nAnn
+{
+  Insertion *ins = an->ins + i ;
+  if (i == *nWritable) *nWritable = annotatorWait (an, i) ;
+  insertionWrite (of, ins, annotatorSeq (an, ins)) ;
+  if (ins->tsdLen) ++nAnn[0] ;
+  if (ins->tirLen) ++nAnn[1] ;
+  if (ins->ltrLen) ++nAnn[2] ;
+}
+
+void insertionReport (OneFile *of, AlnSeq *as, Array a)
+// write the variants in a, adding sequences from as unless it is 0
+{
+  U64 i ;
+
+  statsPhase ("sort") ;
+  insertionSortParallel (arrp(a,0,Insertion), arrayMax(a)) ;
+  statsPhase ("merge") ;
+  U64 nCalls = arrayMax(a) ;
+  arrayMax(a) = insertionCluster (arrp(a,0,Insertion), arrayMax(a)) ;
+  printf ("merged %llu calls into %llu variants\n", nCalls, (U64)arrayMax(a)) ;
+  statsAdd ("calls", nCalls) ; statsAdd ("variants", arrayMax(a)) ;
+
+  if (!as) // write the records alone
+    { statsPhase ("write") ;
+      for (i = 0 ; i < arrayMax (a) ; ++i) insertionWrite (of, arrp(a,i,Insertion), 0) ;
+      return ;
+    }
+
+  // Copy each insertion with its flanks into a pool in one pass through the sequences, so that
+  // writing need not re-read them.  Annotation runs in parallel threads behind this, on each
+  // insertion once it is copied, and writing follows in order as each is annotated.  The pool
+  // is a ring of fixed size, so it does not move under the threads: when the next insertion
+  // does not fit, the oldest are written to free their space.  Its place is set from the
+  // unclipped flank sizes, and never wraps within an insertion.
+  Insertion *ins ;
+  U64        n = arrayMax (a), ias = 0, sLen = 0, need, poolMax = 0, poolSize = 0, head = 0 ;
+  for (i = 0, ins = arrp(a,0,Insertion) ; i < n ; ++i, ++ins)
+    { ins->lo = ins->a_begin - MAX_OVERHANG - MAX_TSD - 1 ; if (ins->lo < 0) ins->lo = 0 ;
+      ins->hi = ins->a_end + MAX_TSD + 1 ;
+      need = ins->hi - ins->lo ;
+      poolMax += need ;
+      if (need > poolSize) poolSize = need ;
+    }
+  if (poolSize < POOL_SIZE) poolSize = (poolMax < POOL_SIZE) ? poolMax + 1 : POOL_SIZE ;
+  Annotator an = { arrp(a,0,Insertion), n, new (poolSize, char), poolSize, 0, 0, new0 (n+1, bool),
+		   PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER } ;
+  if (!seqPacker) seqPacker = seqPackCreate ('a') ;
+  int        t, nThreads = (NTHREADS < n) ? NTHREADS : (n ? n : 1) ;
+  pthread_t *threads = new (nThreads, pthread_t) ;
+  for (t = 0 ; t < nThreads ; ++t) pthread_create (&threads[t], 0, annotateThread, &an) ;
+
+  statsPhase ("extract") ;	// including writes to free pool space
+  U64   iw = 0, nWritable = 0 ; // next insertion to write, end of the annotated run from it
+  int   nAnn[3] = { 0, 0, 0 } ; // TSDs, TIRs, LTRs
   char *s = alnSeqNext (as, &sLen) ; // get 0'th sequence
-  char *idBuf = new(256,char) ;
-  for (i = 0 ; i < arrayMax (a) ; ++i)
-    { Insertion *ins = arrp(a,i,Insertion) ;
-      oneInt(of,0) = ins->a ; oneInt(of,1) = ins->a_begin ; oneInt(of,2) = ins->a_end ;
-      oneWriteLine (of, 'V', 0, 0) ;
-      oneInt(of,0) = ins->b ; oneInt(of,1) = ins->b_match_begin ; oneInt(of,2) = ins->b_match_end ;
-      oneWriteLine (of, 'B', 0, 0) ;
-      while (ias < ins->a)
-	{ s = alnSeqNext (as, &sLen) ;
-	  if (!s) die ("run out of contig sequences at %lld < %d", ias, ins->a) ;
-	  ++ias ;
+  for (i = 0, ins = an.ins ; i < n ; ++i, ++ins)
+    { if (ias < ins->a)
+	{ annotatorReady (&an, i) ; // all before i are copied
+	  while (ias < ins->a)
+	    { s = alnSeqNext (as, &sLen) ;
+	      if (!s) die ("run out of contig sequences at %lld < %d", ias, ins->a) ;
+	      ++ias ;
+	    }
+	}
+      if (ins->a_end > sLen)
+	die ("variant %d:%d-%d extends beyond sequence length %lld", ins->a, ins->a_begin, ins->a_end, sLen) ;
+      need = ins->hi - ins->lo ;
+      if (head % poolSize + need > poolSize) head += poolSize - head % poolSize ; // no wrap
+      if (iw < i && head + need > an.ins[iw].pool + poolSize) // full: write the oldest
+	{ annotatorReady (&an, i) ;
+	  while (iw < i && head + need > an.ins[iw].pool + poolSize)
+	    annotatedWrite (of, &an, iw++, &nWritable, nAnn) ;
 	}
-      oneWriteLine (of, 'S', ins->a_end - ins->a_begin, s + ins->a_begin) ;
-      sprintf (idBuf,"%d:%d-%d_%d:%d-%d",
-	       ins->a, ins->a_begin, ins->a_end, ins->b, ins->b_match_begin, ins->b_match_end) ;
-      oneWriteLine (of, 'I', strlen(idBuf), idBuf) ;
+      ins->pool = head ; head += need ;
+      if (ins->hi > sLen) ins->hi = sLen ;
+      memcpy (annotatorSeq (&an, ins) + ins->lo, s + ins->lo, ins->hi - ins->lo) ;
+      if ((i & 0xff) == 0xff) annotatorReady (&an, i+1) ;
     }
-  free (idBuf) ;
-  arrayDestroy (a) ;
+  annotatorReady (&an, n) ;
+  statsAdd ("flank bytes extracted", poolMax) ;
+
+  statsPhase ("write") ;
+  while (iw < n) annotatedWrite (of, &an, iw++, &nWritable, nAnn) ;
+  for (t = 0 ; t < nThreads ; ++t) pthread_join (threads[t], 0) ;
+  free (threads) ; free (an.pool) ; free (an.isDone) ;
+  printf ("annotated %d TSDs, %d TIRs, %d LTRs\n", nAnn[0], nAnn[1], nAnn[2]) ;
 }
@@ -64,7 +64,7 @@ void *myalloc (size_t size)
 {
   void *p = (void*) malloc (size) ;
   if (!p) die ("myalloc failure requesting %d bytes - totalAllocated %ld", size, totalAllocated) ;
-  totalAllocated += size ;
+  __atomic_add_fetch (&totalAllocated, size, __ATOMIC_RELAXED) ; /* threads allocate too */
   return p ;
 }
 
@@ -72,7 +72,7 @@ void *mycalloc (size_t number, size_t size)
 {
   void *p = (void*) calloc (number, size) ;
   if (!p) die ("mycalloc failure requesting %d objects of size %d - totalAllocated %ld", number, size, totalAllocated) ;
-  totalAllocated += size*number ;
+  __atomic_add_fetch (&totalAllocated, size*number, __ATOMIC_RELAXED) ;
   return p ;
 }
 
@@ -233,4 +233,125 @@ void timeUpdate (FILE *f)
 
 void timeTotal (FILE *f) { rOld = rFirst ; tOld = tFirst ; timeUpdate (f) ; }
 
+/***************** instrumentation: counters and phase timers ******************/
+
+#include <pthread.h>
+#include <unistd.h>
+
+#define STATS_MAX 256
+
+typedef struct { char *name ; I64 n ; } StatsCounter ;
+typedef struct { char *name ; double user, system, elapsed ; } StatsPhase ;
+
+bool isStats = false ;
+
+static StatsCounter    counter[STATS_MAX] ;
+static int             nCounter = 0 ;
+static StatsPhase      phase[STATS_MAX] ;
+static int             nPhase = 0 ;
+static int             curPhase = -1 ;	/* index of the current phase, if any */
+static struct rusage   rPhase ;		/* at the start of the current phase */
+static struct timeval  tPhase, tStats ;
+static pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER ;
+static FILE           *progressFile ;
+static int             progressInterval ;
+
+static double secsSince (struct timeval *t0, struct timeval *t1)
+{ return (t1->tv_sec - t0->tv_sec) + (t1->tv_usec - t0->tv_usec) / 1000000.0 ; }
+
+static void phaseEnd (void) /* caller holds statsLock; also marks the start of the next phase */
+{
+  struct rusage r ;
+  struct timeval t ;
+  getrusage (RUSAGE_SELF, &r) ;
+  gettimeofday (&t, 0) ;
+  if (curPhase >= 0)
+    { StatsPhase *p = &phase[curPhase] ;
+      p->user += secsSince (&rPhase.ru_utime, &r.ru_utime) ;
+      p->system += secsSince (&rPhase.ru_stime, &r.ru_stime) ;
+      p->elapsed += secsSince (&tPhase, &t) ;
+    }
+  rPhase = r ; tPhase = t ;
+}
+
+static void *progressThread (void *arg)
+{
+  int i ;
+  struct timeval t ;
+  while (true)
+    { sleep (progressInterval) ;
+      pthread_mutex_lock (&statsLock) ;
+      if (!isStats) { pthread_mutex_unlock (&statsLock) ; return 0 ; }
+      gettimeofday (&t, 0) ;
+      fprintf (progressFile, "progress %.1fs phase %s", secsSince (&tStats, &t),
+	       curPhase >= 0 ? phase[curPhase].name : "-") ;
+      for (i = 0 ; i < nCounter ; ++i) fprintf (progressFile, " | %s %lld", counter[i].name, counter[i].n) ;
+      fputc ('\n', progressFile) ;
+      fflush (progressFile) ;
+      pthread_mutex_unlock (&statsLock) ;
+    }
+}
+
+void statsStart (FILE *progress, int interval)
+{
+  if (isStats) return ;
+  gettimeofday (&tStats, 0) ;
+  isStats = true ;
+  if (progress && interval > 0)
+    { pthread_t thread ;
+      progressFile = progress ; progressInterval = interval ;
+      pthread_create (&thread, 0, progressThread, 0) ;
+      pthread_detach (thread) ;
+    }
+}
+
+void statsPhase (char *name)
+{
+  int i ;
+  if (!isStats) return ;
+  pthread_mutex_lock (&statsLock) ;
+  phaseEnd () ;
+  for (i = 0 ; i < nPhase ; ++i) if (!strcmp (phase[i].name, name)) break ;
+  if (i == nPhase && nPhase < STATS_MAX)
+    { phase[nPhase].name = strdup (name) ;
+      phase[nPhase].user = phase[nPhase].system = phase[nPhase].elapsed = 0 ;
+      ++nPhase ;
+    }
+  if (i < nPhase) curPhase = i ;	/* a repeated phase accumulates */
+  pthread_mutex_unlock (&statsLock) ;
+}
+
+void statsAdd (char *name, I64 n)
+{
+  int i ;
+  if (!isStats) return ;
+  pthread_mutex_lock (&statsLock) ;
+  for (i = 0 ; i < nCounter ; ++i) if (!strcmp (counter[i].name, name)) break ;
+  if (i == nCounter && nCounter < STATS_MAX)
+    { counter[nCounter].name = strdup (name) ; counter[nCounter++].n = 0 ; }
+  if (i < nCounter) counter[i].n += n ;
+  pthread_mutex_unlock (&statsLock) ;
+}
+
+void statsReport (FILE *f)
+{
+  int i ;
+  struct timeval t ;
+  if (!isStats) return ;
+  pthread_mutex_lock (&statsLock) ;
+  phaseEnd () ;
+  curPhase = -1 ;
+  gettimeofday (&t, 0) ;
+  fprintf (f, "{\n  \"elapsed\": %.6f,\n  \"phases\": [", secsSince (&tStats, &t)) ;
+  for (i = 0 ; i < nPhase ; ++i)
+    fprintf (f, "%s\n    { \"name\": \"%s\", \"user\": %.6f, \"system\": %.6f, \"elapsed\": %.6f }",
+	     i ? "," : "", phase[i].name, phase[i].user, phase[i].system, phase[i].elapsed) ;
+  fprintf (f, "\n  ],\n  \"counters\": {") ;
+  for (i = 0 ; i < nCounter ; ++i)
+    fprintf (f, "%s\n    \"%s\": %lld", i ? "," : "", counter[i].name, counter[i].n) ;
+  fprintf (f, "\n  }\n}\n") ;
+  isStats = false ;		/* stops the progress thread */
+  pthread_mutex_unlock (&statsLock) ;
+}
+
 /********************* end of file ***********************/
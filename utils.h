@@ -60,4 +60,14 @@ char *fnameTag (char* root, char* tag) ; /* utility to return name as used by fo
 void timeUpdate (FILE *f) ;	/* print time usage since last call to file */
 void timeTotal (FILE *f) ;	/* print full time usage since first call to timeUpdate */
 
+/* instrumentation: named counters and phase timers, with optional progress reports and a final
+   JSON summary.  Until statsStart() is called every call below returns at once, so it is cheap
+   to leave them in, but counters are locked, so add per batch rather than per item */
+
+extern bool isStats ;
+void statsStart (FILE *progress, int interval) ; /* progress every interval seconds if > 0 */
+void statsPhase (char *name) ;	/* start timing phase name, ending the current one */
+void statsAdd (char *name, I64 n) ; /* add n to counter name: threadsafe */
+void statsReport (FILE *f) ;	/* end the current phase and write everything as JSON */
+
 /************************/